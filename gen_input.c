@@ -0,0 +1,308 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+	Writes a synthetic input.csv to stdout for benchmarking the solver.
+
+	Each person gets random blocks of holiday up to the requested density,
+	and some fraction of people are part time, cannot be on call on a fixed
+	weekday, dislike a few days, cannot do ward weeks, or start or finish
+	partway through.  Bank holidays fall on random Mondays, and some
+	weekdays have a person who must be on call (never while on holiday).
+*/
+
+#define EPOCH_YEAR			1900
+#define MAX_PEOPLE			1000
+#define MAX_WEEKS			520
+
+typedef struct tm tm_t;
+
+typedef struct
+{
+	int cannot_on_call_weekday;
+	int first_day;
+	int last_day;
+	bool is_part_time;
+	bool cannot_do_ward_weeks;
+} gen_person_t;
+
+typedef struct
+{
+	int person_count;
+	int week_count;
+	uint64_t seed;
+	float holiday_density;
+	int bank_holidays_per_year;
+	float part_time_fraction;
+	float forced_on_call_density;
+	int start_day;
+	int start_month;
+	int start_year;
+} gen_options_t;
+
+uint64_t g_rng_state;
+
+uint64_t gen_rand_next(void)
+{
+	// splitmix64
+	uint64_t z = (g_rng_state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30))*0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27))*0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+int gen_rand(int count)
+{
+	return (int)((gen_rand_next() >> 33) % (uint64_t)count);
+}
+
+float gen_rand_float(void)
+{
+	return (float)(gen_rand_next() >> 40)*(1.f/16777216.f);
+}
+
+void print_usage(void)
+{
+	fprintf(stderr, "usage: gen_input [options] > input.csv\n\
+options:\n\
+  --people N             number of people (default: 20, at most %d)\n\
+  --weeks N              number of weeks (default: 26, at most %d)\n\
+  --seed N               random seed (default: 1)\n\
+  --holidays F           fraction of days each person is on holiday (default: 0.08)\n\
+  --bank-holidays N      bank holidays per 52 weeks (default: 8)\n\
+  --part-time F          fraction of people who are part time (default: 0.2)\n\
+  --forced-on-call F     fraction of weekdays with a forced on call person (default: 0.01)\n\
+  --start DD/MM/YYYY     first day, which must be a Monday (default: 04/01/2016)\n\
+",
+		MAX_PEOPLE,
+		MAX_WEEKS);
+}
+
+void parse_options(int argc, char *argv[], gen_options_t *options)
+{
+	memset(options, 0, sizeof(gen_options_t));
+	options->person_count = 20;
+	options->week_count = 26;
+	options->seed = 1;
+	options->holiday_density = .08f;
+	options->bank_holidays_per_year = 8;
+	options->part_time_fraction = .2f;
+	options->forced_on_call_density = .01f;
+	options->start_day = 4;
+	options->start_month = 1;
+	options->start_year = 2016;
+
+	for (int i = 1; i < argc; ++i) {
+		char const *const arg = argv[i];
+		char const *const value = (i + 1 < argc) ? argv[i + 1] : NULL;
+		bool is_valid = true;
+		if (!value) {
+			is_valid = false;
+		} else if (strcmp(arg, "--people") == 0) {
+			options->person_count = atoi(value);
+			is_valid = (0 < options->person_count && options->person_count <= MAX_PEOPLE);
+		} else if (strcmp(arg, "--weeks") == 0) {
+			options->week_count = atoi(value);
+			is_valid = (0 < options->week_count && options->week_count <= MAX_WEEKS);
+		} else if (strcmp(arg, "--seed") == 0) {
+			options->seed = strtoull(value, NULL, 0);
+		} else if (strcmp(arg, "--holidays") == 0) {
+			options->holiday_density = (float)atof(value);
+			is_valid = (0.f <= options->holiday_density && options->holiday_density < 1.f);
+		} else if (strcmp(arg, "--bank-holidays") == 0) {
+			options->bank_holidays_per_year = atoi(value);
+			is_valid = (0 <= options->bank_holidays_per_year && options->bank_holidays_per_year <= 52);
+		} else if (strcmp(arg, "--part-time") == 0) {
+			options->part_time_fraction = (float)atof(value);
+			is_valid = (0.f <= options->part_time_fraction && options->part_time_fraction <= 1.f);
+		} else if (strcmp(arg, "--forced-on-call") == 0) {
+			options->forced_on_call_density = (float)atof(value);
+			is_valid = (0.f <= options->forced_on_call_density && options->forced_on_call_density <= 1.f);
+		} else if (strcmp(arg, "--start") == 0) {
+			is_valid = (sscanf(value, "%d/%d/%d", &options->start_day, &options->start_month, &options->start_year) == 3);
+		} else {
+			is_valid = false;
+		}
+		if (!is_valid) {
+			if (strcmp(arg, "--help") != 0) {
+				fprintf(stderr, "bad option \"%s\"!\n", arg);
+			}
+			print_usage();
+			exit(-1);
+		}
+		++i;
+	}
+}
+
+void print_row(char const *name, char const *category, char const *const *cells, int day_count)
+{
+	printf("%s,%s,", name, category);
+	for (int i = 0; i < day_count; ++i) {
+		printf("%s,", cells[i] ? cells[i] : "");
+	}
+	printf("\n");
+}
+
+void clear_cells(char const **cells, int day_count)
+{
+	memset(cells, 0, day_count*sizeof(char const *));
+}
+
+int main(int argc, char *argv[])
+{
+	gen_options_t options;
+	parse_options(argc, argv, &options);
+	g_rng_state = options.seed;
+
+	int const person_count = options.person_count;
+	int const day_count = 7*options.week_count;
+	char const **const cells = (char const **)malloc(day_count*sizeof(char const *));
+	bool *const holidays = (bool *)calloc(person_count*day_count, sizeof(bool));
+	int *const forced_on_call_people = (int *)malloc(day_count*sizeof(int));
+	gen_person_t *const people = (gen_person_t *)malloc(person_count*sizeof(gen_person_t));
+
+	// header row of dates
+	tm_t tm;
+	memset(&tm, 0, sizeof(tm_t));
+	tm.tm_year = options.start_year - EPOCH_YEAR;
+	tm.tm_mon = options.start_month - 1;
+	tm.tm_mday = options.start_day;
+	tm.tm_hour = 12;
+	tm.tm_isdst = -1;
+	if (mktime(&tm) == (time_t)-1 || tm.tm_wday != 1) {
+		fprintf(stderr, "start date must be a Monday!\n");
+		exit(-1);
+	}
+	printf("Name,Category,");
+	for (int i = 0; i < day_count; ++i) {
+		tm_t day = tm;
+		day.tm_mday += i;
+		mktime(&day);
+		printf("%02d/%02d/%04d,", day.tm_mday, day.tm_mon + 1, day.tm_year + EPOCH_YEAR);
+	}
+	printf("\n");
+
+	// choose availability up front so forced on call days can respect it
+	for (int person = 0; person < person_count; ++person) {
+		gen_person_t *const p = &people[person];
+		p->cannot_on_call_weekday = (gen_rand_float() < .15f) ? gen_rand(5) : -1;
+		p->first_day = 0;
+		p->last_day = day_count - 1;
+		if (options.week_count >= 4 && gen_rand_float() < .05f) {
+			if (gen_rand(2) == 0) {
+				p->first_day = 7*(1 + gen_rand(options.week_count/4));
+			} else {
+				p->last_day = day_count - 1 - 7*(1 + gen_rand(options.week_count/4));
+			}
+		}
+		p->is_part_time = (gen_rand_float() < options.part_time_fraction);
+		p->cannot_do_ward_weeks = (gen_rand_float() < .05f);
+
+		// holidays in blocks of 3 to 10 days until the density is reached
+		bool *const person_holidays = &holidays[person*day_count];
+		int const holiday_target = (int)(options.holiday_density*(float)day_count);
+		int holiday_count = 0;
+		while (holiday_count < holiday_target) {
+			int const first = gen_rand(day_count);
+			int const length = 3 + gen_rand(8);
+			for (int i = first; i < first + length && i < day_count; ++i) {
+				if (!person_holidays[i]) {
+					person_holidays[i] = true;
+					++holiday_count;
+				}
+			}
+		}
+	}
+
+	// forced on call weekdays for someone not on holiday
+	for (int i = 0; i < day_count; ++i) {
+		forced_on_call_people[i] = -1;
+		if ((i % 7) < 5 && gen_rand_float() < options.forced_on_call_density) {
+			int const person = gen_rand(person_count);
+			gen_person_t const *const p = &people[person];
+			bool const is_available = (p->first_day <= i && i + 1 <= p->last_day && (i % 7) != p->cannot_on_call_weekday);
+			if (is_available && !holidays[person*day_count + i] && !holidays[person*day_count + i + 1]) {
+				forced_on_call_people[i] = person;
+			}
+		}
+	}
+
+	for (int person = 0; person < person_count; ++person) {
+		gen_person_t const *const p = &people[person];
+		char name[32];
+		snprintf(name, sizeof(name), "Person %03d", person + 1);
+
+		clear_cells(cells, day_count);
+		for (int i = 0; i < day_count; ++i) {
+			if (holidays[person*day_count + i]) {
+				cells[i] = "x";
+			}
+		}
+		print_row(name, "holiday", cells, day_count);
+
+		if (p->is_part_time) {
+			static char const *const amounts[] = { "0.5", "0.6", "0.8" };
+			clear_cells(cells, day_count);
+			cells[0] = amounts[gen_rand(3)];
+			print_row(name, "part time", cells, day_count);
+		}
+		if (p->cannot_on_call_weekday != -1) {
+			clear_cells(cells, day_count);
+			cells[p->cannot_on_call_weekday] = "x";
+			print_row(name, "always cannot be on call", cells, day_count);
+		}
+		if (gen_rand_float() < .3f) {
+			clear_cells(cells, day_count);
+			int const disliked_count = 1 + gen_rand(4);
+			for (int i = 0; i < disliked_count; ++i) {
+				cells[gen_rand(day_count)] = "x";
+			}
+			print_row(name, "prefer not on call", cells, day_count);
+		}
+		if (p->cannot_do_ward_weeks) {
+			clear_cells(cells, day_count);
+			cells[0] = "x";
+			print_row(name, "no ward weeks", cells, day_count);
+		}
+		if (p->first_day != 0) {
+			clear_cells(cells, day_count);
+			cells[p->first_day] = "x";
+			print_row(name, "start date", cells, day_count);
+		}
+		if (p->last_day != day_count - 1) {
+			clear_cells(cells, day_count);
+			cells[p->last_day] = "x";
+			print_row(name, "end date", cells, day_count);
+		}
+
+		clear_cells(cells, day_count);
+		bool has_forced_on_call = false;
+		for (int i = 0; i < day_count; ++i) {
+			if (forced_on_call_people[i] == person) {
+				cells[i] = "x";
+				has_forced_on_call = true;
+			}
+		}
+		if (has_forced_on_call) {
+			print_row(name, "must be on call", cells, day_count);
+		}
+	}
+
+	// bank holidays on random Mondays
+	clear_cells(cells, day_count);
+	int const bank_holiday_count = (options.bank_holidays_per_year*options.week_count + 51)/52;
+	for (int i = 0; i < bank_holiday_count; ++i) {
+		cells[7*gen_rand(options.week_count)] = "x";
+	}
+	print_row("", "bank holiday", cells, day_count);
+
+	free(people);
+	free(forced_on_call_people);
+	free(holidays);
+	free(cells);
+	return 0;
+}
@@ -1,10 +1,41 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200112L
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+#include <stdarg.h>
 #include <time.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#if defined(__AVX2__) || defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+#ifndef COLLECT_STATS
+#define COLLECT_STATS	0
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif COLLECT_STATS && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#endif
+
 #ifdef _MSC_VER
 #pragma warning(disable: 4702) // unreachable code
 #endif
@@ -17,6 +48,7 @@ typedef struct tm tm_t;
 
 #define DIV_ROUND_UP(N, D)	(((N) + ((D) - 1)) / (D))
 #define MIN(A, B)			(((A) < (B)) ? (A) : (B))
+#define MAX(A, B)			(((A) > (B)) ? (A) : (B))
 
 /*
 	Goals that fail the schedule:
@@ -45,13 +77,22 @@ typedef struct tm tm_t;
 */
 
 
-#define MAX_PERSON_COUNT	32
-#define MAX_WEEK_COUNT		32
-
 #define MAX_PERSON_NAME_LENGTH		64
 
 typedef unsigned int uint;
 
+/*
+	A set of people for each day or week, as an array of bitsets.  Each
+	set is word_count 64-bit words, which grows as people are added, so
+	rotas of up to 64 people test a single word.
+*/
+typedef struct
+{
+	int set_count;
+	int word_count;
+	uint64_t *words;
+} person_bits_t;
+
 typedef struct
 {
 	char name[MAX_PERSON_NAME_LENGTH];
@@ -77,21 +118,50 @@ typedef struct
 	float target_ward_week_spacing;
 } person_config_t;
 
+typedef struct
+{
+	char date[36];
+	int weekday_index;
+	bool is_bank_holiday;
+} calendar_day_t;
+
 typedef struct
 {
 	int person_count;
 	int week_count;
 	time_t first_day;
-
-	person_config_t people[MAX_PERSON_COUNT];
-
-	uint bank_holiday_bits[DIV_ROUND_UP(MAX_WEEK_COUNT*7, 32)];
-	uint holiday_day_bits[MAX_WEEK_COUNT*7 + 1];
-	uint invalid_on_call_day_bits[MAX_WEEK_COUNT*7];
-	uint invalid_ward_week_bits[MAX_WEEK_COUNT];
-	uint disliked_on_call_day_bits[MAX_WEEK_COUNT*7];
-	uint disliked_ward_week_bits[MAX_WEEK_COUNT];
-	int forced_on_call_people[MAX_WEEK_COUNT*7];
+	calendar_day_t *calendar;
+
+	int person_capacity;
+	person_config_t *people;
+
+	uint *bank_holiday_bits;
+	person_bits_t holiday_day_bits;
+	person_bits_t invalid_on_call_day_bits;
+	person_bits_t invalid_ward_week_bits;
+	person_bits_t disliked_on_call_day_bits;
+	person_bits_t disliked_ward_week_bits;
+	int *forced_on_call_people;
+
+	// shifts of a previous rota to stay close to (-1 where unknown), and
+	// the weeks that mutations may touch
+	int *previous_shifts;
+	int active_week_count;
+	int *active_weeks;
+	bool *is_active_week;
+
+	// shifts decided by the input alone (-1 where free), and the free shifts
+	// in active weeks that mutations pick from
+	int *fixed_shifts;
+	int free_slot_count;
+	int *free_slots;
+
+	// hash of the files read, for checkpoints to check against
+	uint64_t input_hash;
+
+	int day_record_word_count;
+	int day_record_stride;
+	uint64_t *day_records;
 
 	float total_on_call_days_and_bias;
 	float total_on_call_weekends_and_bias;
@@ -123,6 +193,7 @@ enum
 	POINTS_DAY_OFF_DECAY,
 	POINTS_NO_WARD_WEEK,
 	POINTS_NO_WARD_WEEK_DECAY,
+	POINTS_CHANGED_FROM_PREVIOUS,
 	POINTS_COUNT
 };
 
@@ -147,14 +218,141 @@ static const char *const g_points_names[POINTS_COUNT] =
 	"day_off",
 	"day_off_decay",
 	"no_ward_week",
-	"no_ward_week_decay"
+	"no_ward_week_decay",
+	"changed_from_previous"
 };
 
+typedef struct
+{
+	float value;
+	int failure_count;
+#if COLLECT_STATS
+	uint8_t points_counts[POINTS_COUNT];
+#endif
+} penalty_t;
+
 typedef struct
 {
 	float values[POINTS_COUNT];
+
+	// tables built by read_points for the horizon of the config
+	int max_day_gap;
+	int max_week_gap;
+	float *days_off_scores;
+	float *no_ward_week_scores;
+	penalty_t *slot_penalties;
+
+	// per (week, shift), the people who would break no hard constraint there
+	int eligible_word_count;
+	uint64_t *eligible_people;
+	int *eligible_counts;
 } points_t;
 
+/*
+	Run statistics.
+
+	Define COLLECT_STATS to 1 to count proposals, acceptances and
+	improvements per move type, how often each points term fires while
+	rescoring moves, and the cycles spent in each part of a move.  Each
+	thread counts into its own thread local stats_t, and these are merged
+	at the end of each thread and written out as JSON at the end of the
+	run.  Otherwise the counters compile away to nothing.
+*/
+
+typedef enum
+{
+	MOVE_REASSIGN,
+	MOVE_BATCHED_REASSIGN,
+	MOVE_SWAP,
+	MOVE_REPAIR,
+
+	// compound moves, kept last
+	MOVE_WEEK_SWAP,
+	MOVE_PERSON_SWAP,
+	MOVE_WARD_WEEKEND_SWAP,
+	MOVE_CHAIN_SWAP,
+
+	MOVE_COUNT
+} move_t;
+
+typedef enum
+{
+	SECTION_MOVE,
+	SECTION_CHAINS,
+	SECTION_WEEKS,
+	SECTION_FAIRNESS,
+	SECTION_ACCEPT,
+
+	SECTION_COUNT
+} section_t;
+
+static char const *const g_move_names[MOVE_COUNT] =
+{
+	"reassign",
+	"batched_reassign",
+	"swap",
+	"repair",
+	"week_swap",
+	"person_swap",
+	"ward_weekend_swap",
+	"chain_swap",
+};
+
+#if COLLECT_STATS
+
+static char const *const g_section_names[SECTION_COUNT] =
+{
+	"move",
+	"chains",
+	"weeks",
+	"fairness",
+	"accept",
+};
+
+typedef struct
+{
+	int64_t move_proposal_counts[MOVE_COUNT];
+	int64_t move_accept_counts[MOVE_COUNT];
+	int64_t move_improvement_counts[MOVE_COUNT];
+	int64_t points_counts[POINTS_COUNT];
+	int64_t section_counts[SECTION_COUNT];
+	uint64_t section_cycles[SECTION_COUNT];
+} stats_t;
+
+#ifdef _WIN32
+#define THREAD_LOCAL		__declspec(thread)
+#else
+#define THREAD_LOCAL		__thread
+#endif
+
+static THREAD_LOCAL stats_t g_thread_stats;
+
+uint64_t read_cycle_counter(void)
+{
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return (uint64_t)clock();
+#endif
+}
+
+#define STATS_COUNT_POINTS(INDEX, COUNT)	(g_thread_stats.points_counts[INDEX] += (COUNT))
+#define STATS_BEGIN(NAME)					uint64_t const NAME##_start_cycles = read_cycle_counter()
+#define STATS_END(NAME, SECTION)			(++g_thread_stats.section_counts[SECTION], g_thread_stats.section_cycles[SECTION] += read_cycle_counter() - NAME##_start_cycles)
+#define STATS_RECORD_MOVE(MOVE, IS_ACCEPTED, IS_IMPROVEMENT) \
+	(++g_thread_stats.move_proposal_counts[MOVE], \
+	g_thread_stats.move_accept_counts[MOVE] += (IS_ACCEPTED), \
+	g_thread_stats.move_improvement_counts[MOVE] += (IS_IMPROVEMENT))
+
+#else
+
+#define STATS_COUNT_POINTS(INDEX, COUNT)	((void)0)
+#define STATS_BEGIN(NAME)
+#define STATS_END(NAME, SECTION)			((void)0)
+#define STATS_RECORD_MOVE(MOVE, IS_ACCEPTED, IS_IMPROVEMENT)	((void)(MOVE))
+
+#endif // COLLECT_STATS
+
 enum
 {
 	SHIFT_ON_CALL_MON,
@@ -174,7 +372,8 @@ typedef struct
 
 typedef struct
 {
-	week_t weeks[MAX_WEEK_COUNT];
+	int week_count;
+	week_t weeks[];
 } rota_t;
 
 enum
@@ -223,12 +422,48 @@ typedef struct
 
 typedef struct
 {
-	person_score_t people[MAX_PERSON_COUNT];
-	float value;
+	double value;
 	int failure_count;
 	failure_data_t failure_data[MAX_FAILURE_COUNT];
+	int person_count;
+	person_score_t people[];
 } score_t;
 
+size_t get_rota_size(int week_count)
+{
+	return sizeof(rota_t) + week_count*sizeof(week_t);
+}
+
+rota_t *alloc_rota(config_t const *config)
+{
+	rota_t *const rota = (rota_t *)calloc(1, get_rota_size(config->week_count));
+	rota->week_count = config->week_count;
+	return rota;
+}
+
+void copy_rota(rota_t *dst, rota_t const *src)
+{
+	memcpy(dst, src, get_rota_size(src->week_count));
+}
+
+size_t get_score_size(int person_count)
+{
+	// people, then scratch space for score_rota
+	return sizeof(score_t) + person_count*(sizeof(person_score_t) + 3*sizeof(int));
+}
+
+int *get_score_scratch(score_t *score)
+{
+	return (int *)&score->people[score->person_count];
+}
+
+score_t *alloc_score(config_t const *config)
+{
+	score_t *const score = (score_t *)calloc(1, get_score_size(config->person_count));
+	score->person_count = config->person_count;
+	return score;
+}
+
 void add_failure(score_t *score, int failure, int person_index, int rota_day_index)
 {
 	if (score->failure_count < MAX_FAILURE_COUNT) {
@@ -240,12 +475,94 @@ void add_failure(score_t *score, int failure, int person_index, int rota_day_ind
 	}
 }
 
-extern void init_genrand(unsigned long s);
-extern unsigned long genrand_int32(void);
+/*
+	Random numbers.
+
+	Each search chain owns an rng_t, so several chains can run in one
+	process.  The generator is xoshiro256** by Blackman and Vigna, seeded
+	with splitmix64.  Independent streams are made by copying a generator
+	and jumping the original ahead by 2^128 draws.
+*/
+
+typedef struct
+{
+	uint64_t s[4];
+} rng_t;
+
+uint64_t rotl64(uint64_t x, int k)
+{
+	return (x << k) | (x >> (64 - k));
+}
+
+void rng_init(rng_t *rng, uint64_t seed)
+{
+	// splitmix64 to spread the seed over the state
+	for (int i = 0; i < 4; ++i) {
+		seed += 0x9E3779B97F4A7C15ULL;
+		uint64_t z = seed;
+		z = (z ^ (z >> 30))*0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27))*0x94D049BB133111EBULL;
+		rng->s[i] = z ^ (z >> 31);
+	}
+}
+
+uint64_t rng_next(rng_t *rng)
+{
+	uint64_t *const s = rng->s;
+	uint64_t const result = rotl64(s[1]*5, 7)*9;
+	uint64_t const t = s[1] << 17;
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotl64(s[3], 45);
+	return result;
+}
+
+void rng_jump(rng_t *rng)
+{
+	static uint64_t const jump[4] = {
+		0x180EC6D33CFD0ABAULL, 0xD5A61266F0C9392CULL, 0xA9582618E03FC9AAULL, 0x39ABDC4529B1661CULL
+	};
+	uint64_t s[4] = { 0, 0, 0, 0 };
+	for (int i = 0; i < 4; ++i) {
+		for (int b = 0; b < 64; ++b) {
+			if (jump[i] & (1ULL << b)) {
+				for (int j = 0; j < 4; ++j) {
+					s[j] ^= rng->s[j];
+				}
+			}
+			rng_next(rng);
+		}
+	}
+	memcpy(rng->s, s, sizeof(s));
+}
+
+void rng_split(rng_t *rng, rng_t *stream)
+{
+	*stream = *rng;
+	rng_jump(rng);
+}
+
+int rota_rand(rng_t *rng, int count)
+{
+	// unbiased multiply-shift (Lemire), the rejection is almost never taken
+	uint32_t const range = (uint32_t)count;
+	uint64_t m = (rng_next(rng) >> 32)*range;
+	if ((uint32_t)m < range) {
+		uint32_t const threshold = (0U - range) % range;
+		while ((uint32_t)m < threshold) {
+			m = (rng_next(rng) >> 32)*range;
+		}
+	}
+	return (int)(m >> 32);
+}
 
-int rota_rand(int person_count)
+float rota_rand_float(rng_t *rng)
 {
-	return genrand_int32() % person_count;
+	// uniform in [0, 1) using the top 24 bits
+	return (float)(rng_next(rng) >> 40)*(1.f/16777216.f);
 }
 
 void set_bank_holiday(config_t *config, int rota_day_index)
@@ -262,54 +579,206 @@ bool is_bank_holiday(config_t const *config, int rota_day_index)
 	return (config->bank_holiday_bits[entry_index] & (1U << bit_index)) != 0;
 }
 
+/*
+	Packed per-day records for the scoring sweep.
+
+	The constraints above are stored per constraint, which is convenient
+	while parsing but means the sweep touches several arrays per day.  Once
+	the input is read they are copied into one record per day (plus one
+	past the end, for the day after the last), laid out as:
+
+	* a header word, with the forced on call person + 1 in the low 32 bits
+	  (0 for nobody) and DAY_RECORD_BANK_HOLIDAY
+	* DAY_MASK_COUNT sets of people, each day_record_word_count words,
+	  where the ward week sets are only filled in on Mondays
+*/
+
+enum
+{
+	DAY_MASK_HOLIDAY,
+	DAY_MASK_INVALID_ON_CALL,
+	DAY_MASK_DISLIKED_ON_CALL,
+	DAY_MASK_INVALID_WARD_WEEK,
+	DAY_MASK_DISLIKED_WARD_WEEK,
+	DAY_MASK_NO_WARD_WEEKS,
+	DAY_MASK_COUNT
+};
+
+#define DAY_RECORD_BANK_HOLIDAY		(1ULL << 32)
+
+uint64_t const *get_day_record(config_t const *config, int rota_day_index)
+{
+	return &config->day_records[rota_day_index*config->day_record_stride];
+}
+
+int get_day_forced_on_call_person(uint64_t const *record)
+{
+	return (int)(record[0] & 0xffffffffU) - 1;
+}
+
+bool is_day_bank_holiday(uint64_t const *record)
+{
+	return (record[0] & DAY_RECORD_BANK_HOLIDAY) != 0;
+}
+
+bool test_day_mask(config_t const *config, uint64_t const *record, int mask, int person)
+{
+	int const word_count = config->day_record_word_count;
+	if (word_count == 1) {
+		return ((record[1 + mask] >> person) & 1) != 0;
+	}
+	return ((record[1 + mask*word_count + person/64] >> (person % 64)) & 1) != 0;
+}
+
+void init_person_bits(person_bits_t *bits, int set_count)
+{
+	bits->set_count = set_count;
+	bits->word_count = 1;
+	bits->words = (uint64_t *)calloc(set_count, sizeof(uint64_t));
+}
+
+void grow_person_bits(person_bits_t *bits, int person_count)
+{
+	int const word_count = DIV_ROUND_UP(person_count, 64);
+	if (word_count > bits->word_count) {
+		uint64_t *const words = (uint64_t *)calloc(bits->set_count*word_count, sizeof(uint64_t));
+		for (int i = 0; i < bits->set_count; ++i) {
+			memcpy(&words[i*word_count], &bits->words[i*bits->word_count], bits->word_count*sizeof(uint64_t));
+		}
+		free(bits->words);
+		bits->words = words;
+		bits->word_count = word_count;
+	}
+}
+
+int count_bits(uint64_t word)
+{
+#ifdef _MSC_VER
+	return (int)__popcnt64(word);
+#else
+	return __builtin_popcountll(word);
+#endif
+}
+
+int select_bit(uint64_t word, int n)
+{
+	// index of the nth lowest set bit
+#ifdef __BMI2__
+	word = _pdep_u64(1ULL << n, word);
+#else
+	for (int i = 0; i < n; ++i) {
+		word &= word - 1;
+	}
+#endif
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward64(&index, word);
+	return (int)index;
+#else
+	return __builtin_ctzll(word);
+#endif
+}
+
+void set_person_bit(person_bits_t *bits, int index, int person)
+{
+	bits->words[index*bits->word_count + person/64] |= (1ULL << (person % 64));
+}
+
+bool test_person_bit(person_bits_t const *bits, int index, int person)
+{
+	if (bits->word_count == 1) {
+		return ((bits->words[index] >> person) & 1) != 0;
+	}
+	return ((bits->words[index*bits->word_count + person/64] >> (person % 64)) & 1) != 0;
+}
+
 void set_holiday_day(config_t *config, int rota_day_index, int person)
 {
-	config->holiday_day_bits[rota_day_index] |= (1U << person);
+	set_person_bit(&config->holiday_day_bits, rota_day_index, person);
 }
 
 bool is_holiday_day(config_t const *config, int rota_day_index, int person)
 {
-	return (config->holiday_day_bits[rota_day_index] & (1U << person)) != 0;
+	return test_person_bit(&config->holiday_day_bits, rota_day_index, person);
 }
 
 void set_invalid_on_call_day(config_t *config, int rota_day_index, int person)
 {
-	config->invalid_on_call_day_bits[rota_day_index] |= (1U << person);
+	set_person_bit(&config->invalid_on_call_day_bits, rota_day_index, person);
 }
 
 bool is_invalid_on_call_day(config_t const *config, int rota_day_index, int person)
 {
-	return (config->invalid_on_call_day_bits[rota_day_index] & (1U << person)) != 0;
+	return test_person_bit(&config->invalid_on_call_day_bits, rota_day_index, person);
 }
 
 void set_invalid_ward_week(config_t *config, int week_index, int person)
 {
-	config->invalid_ward_week_bits[week_index] |= (1U << person);
+	set_person_bit(&config->invalid_ward_week_bits, week_index, person);
 }
 
 bool is_invalid_ward_week(config_t const *config, int week_index, int person)
 {
-	return (config->invalid_ward_week_bits[week_index] & (1U << person)) != 0;
+	return test_person_bit(&config->invalid_ward_week_bits, week_index, person);
 }
 
 void set_disliked_ward_week(config_t *config, int week_index, int person)
 {
-	config->disliked_ward_week_bits[week_index] |= (1U << person);
+	set_person_bit(&config->disliked_ward_week_bits, week_index, person);
 }
 
 bool is_disliked_ward_week(config_t const *config, int week_index, int person)
 {
-	return (config->disliked_ward_week_bits[week_index] & (1U << person)) != 0;
+	return test_person_bit(&config->disliked_ward_week_bits, week_index, person);
 }
 
 void set_disliked_on_call_day(config_t *config, int rota_day_index, int person)
 {
-	config->disliked_on_call_day_bits[rota_day_index] |= (1U << person);
+	set_person_bit(&config->disliked_on_call_day_bits, rota_day_index, person);
 }
 
 bool is_disliked_on_call_day(config_t const *config, int rota_day_index, int person)
 {
-	return (config->disliked_on_call_day_bits[rota_day_index] & (1U << person)) != 0;
+	return test_person_bit(&config->disliked_on_call_day_bits, rota_day_index, person);
+}
+
+void copy_day_mask(config_t const *config, uint64_t *record, int mask, person_bits_t const *bits, int index)
+{
+	int const word_count = config->day_record_word_count;
+	memcpy(&record[1 + mask*word_count], &bits->words[index*bits->word_count], word_count*sizeof(uint64_t));
+}
+
+void build_day_records(config_t *config)
+{
+	int const day_count = 7*config->week_count;
+	int const word_count = config->holiday_day_bits.word_count;
+	config->day_record_word_count = word_count;
+	config->day_record_stride = 1 + DAY_MASK_COUNT*word_count;
+	config->day_records = (uint64_t *)calloc((day_count + 1)*config->day_record_stride, sizeof(uint64_t));
+
+	for (int rota_day_index = 0; rota_day_index <= day_count; ++rota_day_index) {
+		uint64_t *const record = &config->day_records[rota_day_index*config->day_record_stride];
+		copy_day_mask(config, record, DAY_MASK_HOLIDAY, &config->holiday_day_bits, rota_day_index);
+		if (rota_day_index == day_count) {
+			break;
+		}
+		record[0] = (uint64_t)(config->forced_on_call_people[rota_day_index] + 1);
+		if (is_bank_holiday(config, rota_day_index)) {
+			record[0] |= DAY_RECORD_BANK_HOLIDAY;
+		}
+		copy_day_mask(config, record, DAY_MASK_INVALID_ON_CALL, &config->invalid_on_call_day_bits, rota_day_index);
+		copy_day_mask(config, record, DAY_MASK_DISLIKED_ON_CALL, &config->disliked_on_call_day_bits, rota_day_index);
+		if ((rota_day_index % 7) == 0) {
+			int const week_index = rota_day_index/7;
+			copy_day_mask(config, record, DAY_MASK_INVALID_WARD_WEEK, &config->invalid_ward_week_bits, week_index);
+			copy_day_mask(config, record, DAY_MASK_DISLIKED_WARD_WEEK, &config->disliked_ward_week_bits, week_index);
+			for (int person = 0; person < config->person_count; ++person) {
+				if (config->people[person].cannot_do_ward_weeks) {
+					record[1 + DAY_MASK_NO_WARD_WEEKS*word_count + person/64] |= (1ULL << (person % 64));
+				}
+			}
+		}
+	}
 }
 
 float sqr(float x)
@@ -317,28 +786,149 @@ float sqr(float x)
 	return x*x;
 }
 
-float get_days_off_score(points_t const *points, int day_difference)
+float *build_decay_table(float score, float decay, int max_difference)
 {
+	// same summation order as a loop over each difference, so values match exactly
+	float *const table = (float *)malloc((max_difference + 1)*sizeof(float));
 	float sum = 0.f;
-	float score = points->values[POINTS_DAY_OFF];
-	float const decay = points->values[POINTS_DAY_OFF_DECAY];
-	for (int i = 1; i < day_difference; ++i) {
+	table[0] = 0.f;
+	for (int i = 1; i <= max_difference; ++i) {
+		table[i] = sum;
 		sum += score;
 		score *= decay;
 	}
-	return sum;
+	return table;
+}
+
+float get_days_off_score(points_t const *points, int day_difference)
+{
+	if (day_difference <= 0) {
+		return 0.f;
+	}
+	STATS_COUNT_POINTS(POINTS_DAY_OFF, day_difference > 1);
+	return points->days_off_scores[MIN(day_difference, points->max_day_gap)];
 }
 
 float get_no_ward_week_score(points_t const *points, int week_difference)
 {
-	float sum = 0.f;
-	float score = points->values[POINTS_NO_WARD_WEEK];
-	float const decay = points->values[POINTS_NO_WARD_WEEK_DECAY];
-	for (int i = 1; i < week_difference; ++i) {
-		sum += score;
-		score *= decay;
+	if (week_difference <= 0) {
+		return 0.f;
+	}
+	STATS_COUNT_POINTS(POINTS_NO_WARD_WEEK, week_difference > 1);
+	return points->no_ward_week_scores[MIN(week_difference, points->max_week_gap)];
+}
+
+/*
+	Slot penalties.
+
+	Many checks in score_rota only depend on the config and on who is in a
+	shift: holidays, the day before a holiday, invalid and disliked days
+	and weeks, no ward weeks and forced on call days.  These are summed per
+	(week, shift, person) once, so that rescoring a week only needs one
+	lookup per shift for them.
+*/
+
+penalty_t const *get_slot_penalty(config_t const *config, points_t const *points, int week_index, int shift, int person)
+{
+	return &points->slot_penalties[(week_index*SHIFT_COUNT + shift)*config->person_count + person];
+}
+
+void add_penalty(penalty_t *penalty, points_t const *points, int points_index, bool is_failure)
+{
+	penalty->value += points->values[points_index];
+#if COLLECT_STATS
+	++penalty->points_counts[points_index];
+#endif
+	if (is_failure) {
+		++penalty->failure_count;
+	}
+}
+
+void add_on_call_day_penalty(config_t const *config, points_t const *points, int rota_day_index, int person, penalty_t *penalty)
+{
+	uint64_t const *const record = get_day_record(config, rota_day_index);
+	if (test_day_mask(config, record, DAY_MASK_HOLIDAY, person)) {
+		add_penalty(penalty, points, POINTS_WORK_ON_HOLIDAY, true);
+	}
+	if ((rota_day_index % 7) < 5 && test_day_mask(config, record + config->day_record_stride, DAY_MASK_HOLIDAY, person)) {
+		add_penalty(penalty, points, POINTS_WORK_ON_HOLIDAY, true);
+	}
+	if (test_day_mask(config, record, DAY_MASK_INVALID_ON_CALL, person)) {
+		add_penalty(penalty, points, POINTS_ON_CALL_ON_INVALID_DAY, true);
+	}
+	int const forced_on_call_person = get_day_forced_on_call_person(record);
+	if (forced_on_call_person != -1 && forced_on_call_person != person) {
+		add_penalty(penalty, points, POINTS_NOT_ON_CALL_WHEN_FORCED, true);
+	}
+	if (test_day_mask(config, record, DAY_MASK_DISLIKED_ON_CALL, person)) {
+		add_penalty(penalty, points, POINTS_ON_CALL_ON_DISLIKED_DAY, false);
+	}
+}
+
+void build_slot_penalties(config_t const *config, points_t *points)
+{
+	int const person_count = config->person_count;
+	points->slot_penalties = (penalty_t *)calloc(config->week_count*SHIFT_COUNT*person_count, sizeof(penalty_t));
+	for (int week_index = 0; week_index < config->week_count; ++week_index) {
+		int const first_day = 7*week_index;
+		uint64_t const *const monday = get_day_record(config, first_day);
+		for (int person = 0; person < person_count; ++person) {
+			for (int shift = 0; shift < SHIFT_COUNT; ++shift) {
+				penalty_t *const penalty = &points->slot_penalties[(week_index*SHIFT_COUNT + shift)*person_count + person];
+				switch (shift) {
+					case SHIFT_ON_CALL_WEEKEND:
+						add_on_call_day_penalty(config, points, first_day + 5, person, penalty);
+						add_on_call_day_penalty(config, points, first_day + 6, person, penalty);
+						break;
+
+					case SHIFT_WARD_WEEK:
+						if (test_day_mask(config, monday, DAY_MASK_NO_WARD_WEEKS, person)) {
+							add_penalty(penalty, points, POINTS_ON_WARD_ON_INVALID_WEEK, true);
+						}
+						for (int day_index = 0; day_index < 5; ++day_index) {
+							if (test_day_mask(config, get_day_record(config, first_day + day_index), DAY_MASK_HOLIDAY, person)) {
+								add_penalty(penalty, points, POINTS_WORK_ON_HOLIDAY, true);
+							}
+						}
+						if (test_day_mask(config, monday, DAY_MASK_INVALID_WARD_WEEK, person)) {
+							add_penalty(penalty, points, POINTS_ON_WARD_ON_INVALID_WEEK, true);
+						}
+						if (test_day_mask(config, monday, DAY_MASK_DISLIKED_WARD_WEEK, person)) {
+							add_penalty(penalty, points, POINTS_WARD_WEEK_ON_DISLIKED_WEEK, false);
+						}
+						break;
+
+					default:
+						add_on_call_day_penalty(config, points, first_day + shift, person, penalty);
+						break;
+				}
+				int const previous_person = config->previous_shifts ? config->previous_shifts[week_index*SHIFT_COUNT + shift] : -1;
+				if (previous_person != -1 && previous_person != person) {
+					add_penalty(penalty, points, POINTS_CHANGED_FROM_PREVIOUS, false);
+				}
+			}
+		}
+	}
+}
+
+void build_eligible_people(config_t const *config, points_t *points)
+{
+	// anyone whose slot penalty has no failures
+	int const person_count = config->person_count;
+	int const slot_count = config->week_count*SHIFT_COUNT;
+	int const word_count = DIV_ROUND_UP(person_count, 64);
+	points->eligible_word_count = word_count;
+	points->eligible_people = (uint64_t *)calloc(slot_count*word_count, sizeof(uint64_t));
+	points->eligible_counts = (int *)calloc(slot_count, sizeof(int));
+	for (int slot = 0; slot < slot_count; ++slot) {
+		uint64_t *const words = &points->eligible_people[slot*word_count];
+		for (int person = 0; person < person_count; ++person) {
+			if (points->slot_penalties[slot*person_count + person].failure_count == 0) {
+				words[person/64] |= 1ULL << (person % 64);
+				++points->eligible_counts[slot];
+			}
+		}
 	}
-	return sum;
 }
 
 void score_rota(
@@ -347,12 +937,13 @@ void score_rota(
 	rota_t const *rota,
 	score_t *score)
 {
-	memset(score, 0, sizeof(score_t));
+	memset(score, 0, get_score_size(config->person_count));
+	score->person_count = config->person_count;
 
 	// sweep as much as possible in one pass
-	int last_on_call_week[MAX_PERSON_COUNT];
-	int last_work_day[MAX_PERSON_COUNT];
-	int last_ward_week[MAX_PERSON_COUNT];
+	int *const last_on_call_week = get_score_scratch(score);
+	int *const last_work_day = last_on_call_week + config->person_count;
+	int *const last_ward_week = last_work_day + config->person_count;
 	for (int i = 0; i < config->person_count; ++i) {
 		last_on_call_week[i] = -1;
 		last_work_day[i] = config->people[i].first_day - 1;
@@ -362,9 +953,21 @@ void score_rota(
 	for (int week_index = 0; week_index < config->week_count; ++week_index) {
 		week_t const *const week = &rota->weeks[week_index];
 
+		// check for changes from a previous rota
+		if (config->previous_shifts) {
+			int const *const previous_shifts = &config->previous_shifts[week_index*SHIFT_COUNT];
+			for (int shift = 0; shift < SHIFT_COUNT; ++shift) {
+				if (previous_shifts[shift] != -1 && previous_shifts[shift] != week->shifts[shift]) {
+					score->value += points->values[POINTS_CHANGED_FROM_PREVIOUS];
+				}
+			}
+		}
+
 		// loop over the days
 		for (int day_index = 0; day_index < 7; ++day_index) {
 			int rota_day_index = week_index*7 + day_index;
+			uint64_t const *const record = get_day_record(config, rota_day_index);
+			uint64_t const *const next_record = record + config->day_record_stride;
 			if (day_index < 5) {
 				int const person_on_call = week->shifts[day_index];
 				int const person_on_ward = week->shifts[SHIFT_WARD_WEEK];
@@ -374,37 +977,37 @@ void score_rota(
 					score->value += points->values[POINTS_SHIFT_OVERLAP];
 					add_failure(score, FAILURE_MULTIPLE_SHIFTS_AT_ONCE, person_on_call, rota_day_index);
 				}
-				if (day_index == 0 && config->people[person_on_ward].cannot_do_ward_weeks) {
+				if (day_index == 0 && test_day_mask(config, record, DAY_MASK_NO_WARD_WEEKS, person_on_ward)) {
 					score->value += points->values[POINTS_ON_WARD_ON_INVALID_WEEK];
 					add_failure(score, FAILURE_ON_WARD_WHEN_CANNOT, person_on_ward, rota_day_index);
 				}
 
 				// check holidays
-				if (is_holiday_day(config, rota_day_index, person_on_call)) {
+				if (test_day_mask(config, record, DAY_MASK_HOLIDAY, person_on_call)) {
 					score->value += points->values[POINTS_WORK_ON_HOLIDAY];
 					add_failure(score, FAILURE_WORK_ON_HOLIDAY, person_on_call, rota_day_index);
 				}
-				if (is_holiday_day(config, rota_day_index, person_on_ward)) {
+				if (test_day_mask(config, record, DAY_MASK_HOLIDAY, person_on_ward)) {
 					score->value += points->values[POINTS_WORK_ON_HOLIDAY];
 					add_failure(score, FAILURE_WORK_ON_HOLIDAY, person_on_ward, rota_day_index);
 				}
-				if (is_holiday_day(config, rota_day_index + 1, person_on_call)) {
+				if (test_day_mask(config, next_record, DAY_MASK_HOLIDAY, person_on_call)) {
 					score->value += points->values[POINTS_WORK_ON_HOLIDAY];
 					add_failure(score, FAILURE_WORK_JUST_BEFORE_HOLIDAY, person_on_call, rota_day_index);
 				}
 
 				// check invalid days
-				if (day_index == 0 && is_invalid_ward_week(config, week_index, person_on_ward)) {
+				if (day_index == 0 && test_day_mask(config, record, DAY_MASK_INVALID_WARD_WEEK, person_on_ward)) {
 					score->value += points->values[POINTS_ON_WARD_ON_INVALID_WEEK];
 					add_failure(score, FAILURE_ON_WARD_WHEN_CANNOT, person_on_ward, rota_day_index);
 				}
-				if (is_invalid_on_call_day(config, rota_day_index, person_on_call)) {
+				if (test_day_mask(config, record, DAY_MASK_INVALID_ON_CALL, person_on_call)) {
 					score->value += points->values[POINTS_ON_CALL_ON_INVALID_DAY];
 					add_failure(score, FAILURE_ON_CALL_WHEN_CANNOT, person_on_call, rota_day_index);
 				}
 
 				// check forced on call days
-				int const forced_on_call_person = config->forced_on_call_people[rota_day_index];
+				int const forced_on_call_person = get_day_forced_on_call_person(record);
 				if (forced_on_call_person != -1 && forced_on_call_person != person_on_call) {
 					score->value += points->values[POINTS_NOT_ON_CALL_WHEN_FORCED];
 					add_failure(score, FAILURE_NOT_ON_CALL_WHEN_FORCED, forced_on_call_person, rota_day_index);
@@ -434,10 +1037,10 @@ void score_rota(
 				}
 
 				// check disliked days
-				if (is_disliked_on_call_day(config, rota_day_index, person_on_call)) {
+				if (test_day_mask(config, record, DAY_MASK_DISLIKED_ON_CALL, person_on_call)) {
 					score->value += points->values[POINTS_ON_CALL_ON_DISLIKED_DAY];
 				}
-				if (day_index == 0 && is_disliked_ward_week(config, week_index, person_on_ward)) {
+				if (day_index == 0 && test_day_mask(config, record, DAY_MASK_DISLIKED_WARD_WEEK, person_on_ward)) {
 					score->value += points->values[POINTS_WARD_WEEK_ON_DISLIKED_WEEK];
 				}
 
@@ -460,7 +1063,7 @@ void score_rota(
 				person_on_call_yesterday = person_on_call;
 
 				// update counters
-				if (is_bank_holiday(config, rota_day_index)) {
+				if (is_day_bank_holiday(record)) {
 					++score->people[person_on_call].total_on_call_bank_holidays;
 				}
 				++score->people[person_on_call].total_on_call_days;
@@ -471,19 +1074,19 @@ void score_rota(
 				int const person_on_call = week->shifts[SHIFT_ON_CALL_WEEKEND];
 
 				// check holidays
-				if (is_holiday_day(config, rota_day_index, person_on_call)) {
+				if (test_day_mask(config, record, DAY_MASK_HOLIDAY, person_on_call)) {
 					score->value += points->values[POINTS_WORK_ON_HOLIDAY];
 					add_failure(score, FAILURE_WORK_ON_HOLIDAY, person_on_call, rota_day_index);
 				}
 
 				// check invalid on call days
-				if (is_invalid_on_call_day(config, rota_day_index, person_on_call)) {
+				if (test_day_mask(config, record, DAY_MASK_INVALID_ON_CALL, person_on_call)) {
 					score->value += points->values[POINTS_ON_CALL_ON_INVALID_DAY];
 					add_failure(score, FAILURE_ON_CALL_WHEN_CANNOT, person_on_call, rota_day_index);
 				}
 
 				// check forced on call days
-				int const forced_on_call_person = config->forced_on_call_people[rota_day_index];
+				int const forced_on_call_person = get_day_forced_on_call_person(record);
 				if (forced_on_call_person != -1 && forced_on_call_person != person_on_call) {
 					score->value += points->values[POINTS_NOT_ON_CALL_WHEN_FORCED];
 					add_failure(score, FAILURE_NOT_ON_CALL_WHEN_FORCED, forced_on_call_person, rota_day_index);
@@ -501,7 +1104,7 @@ void score_rota(
 				}
 
 				// check disliked days
-				if (is_disliked_on_call_day(config, rota_day_index, person_on_call)) {
+				if (test_day_mask(config, record, DAY_MASK_DISLIKED_ON_CALL, person_on_call)) {
 					score->value += points->values[POINTS_ON_CALL_ON_DISLIKED_DAY];
 				}
 
@@ -558,302 +1161,1978 @@ void score_rota(
 	}
 }
 
-void print_rota_html(
-	char const *filename,
-	config_t const *config,
-	rota_t const *rota,
-	score_t const *score)
+/*
+	Incremental scoring.
+
+	The score computed by score_rota splits into three kinds of term:
+
+	* Terms local to a week, which only look at that week and the ward and
+	  weekend shifts of the two weeks before it.
+	* Chains per person, which score the gaps between working days and
+	  between ward weeks.
+	* Fairness per person, which only depend on the shift totals.
+
+	The delta tracker keeps each of these separately so that reassigning a
+	single shift only needs to rescore at most 3 weeks and the parts of 2
+	chains near that shift.  Any change can be undone by rolling back the
+	journal of values that were overwritten since the last commit.
+
+	Define CHECK_DELTA_SCORE to 1 to check the tracker against score_rota
+	after every change.
+*/
+
+#ifndef CHECK_DELTA_SCORE
+#define CHECK_DELTA_SCORE	0
+#endif
+
+#define MAX_JOURNAL_LENGTH	4096
+#define DELTA_RESYNC_INTERVAL	(64*1024)
+
+typedef struct
 {
-	FILE *const fp = fopen(filename, "w");
-	if (!fp) {
-		fprintf(stderr, "failed to open \"%s\" for writing!\n", filename);
-		exit(-1);
-	}
+	int *addr;
+	int value;
+} journal_int_t;
 
-	fprintf(fp, "<!DOCTYPE html>\n\
-<html>\n\
-<head>\n\
-<style>\n\
-table, th, td {\n\
-border: 1px solid black;\n\
-border-collapse: collapse;\n\
-}\n\
-th, td {\n\
-padding: 5px;\n\
-}\n\
-table tr td {\n\
-width: 10px;\n\
-}\n\
-</style>\n\
-</head>\n\
-<body>\n\
-<h1>Rota Output</h1>\n\
-<table>\n\
-<tr><th colspan=\"2\">Key</th></tr>\n\
-<tr><td style=\"white-space: nowrap\">holiday</td><td style=\"background-color:grey\"></td></tr>\n\
-<tr><td style=\"white-space: nowrap\">bank holiday</td><td style=\"background-color:lightblue\"></td></tr>\n\
-<tr><td style=\"white-space: nowrap\">weekend</td><td style=\"background-color:cyan\"></td></tr>\n\
-<tr><td style=\"white-space: nowrap\">ward week</td><td style=\"background-color:yellow\"></td></tr>\n\
-<tr><td style=\"white-space: nowrap\">on call</td><td style=\"background-color:red\"></td></tr>\n\
-</table>\n\
-<br>\n\
-");
+typedef struct
+{
+	double *addr;
+	double value;
+} journal_double_t;
 
-	fprintf(fp, "<table>\n<tr>\n<th>Name</th>\n");
-	for (int week_index = 0; week_index < config->week_count; ++week_index) {
-		time_t const first_day = config->first_day + week_index*7*TIME_DELTA_DAY;
-		tm_t *const tm = localtime(&first_day);
-		fprintf(fp, "<th colspan=\"7\">%d/%d/%d</th>\n", tm->tm_mday, tm->tm_mon + 1, tm->tm_year + EPOCH_YEAR);
+typedef struct
+{
+	config_t const *config;
+	points_t const *points;
+	rota_t *rota;
+
+	double *week_values;
+	double *chain_values;
+	double *fairness_values;
+	person_score_t *people;
+	int *week_failure_counts;
+	int *failing_weeks;
+	int *failing_week_indices;
+	double value;
+	int failure_count;
+	int failing_week_count;
+
+	// work done by the current move, in weeks read while rescoring
+	int week_reads;
+
+	int journal_int_count;
+	int journal_double_count;
+	journal_int_t journal_ints[MAX_JOURNAL_LENGTH];
+	journal_double_t journal_doubles[MAX_JOURNAL_LENGTH];
+	score_t *check_score;
+} delta_t;
+
+float score_week_local(
+	config_t const *config,
+	points_t const *points,
+	rota_t const *rota,
+	int week_index,
+	int *failure_count)
+{
+	// mirrors the checks in score_rota that do not depend on chains or totals
+	week_t const *const week = &rota->weeks[week_index];
+	int const person_on_ward = week->shifts[SHIFT_WARD_WEEK];
+	int person_on_call_yesterday = (week_index > 0) ? rota->weeks[week_index - 1].shifts[SHIFT_ON_CALL_WEEKEND] : -1;
+	float value = 0.f;
+	int failures = 0;
+
+	// checks that only depend on who is in each shift
+	penalty_t const *const slot_penalties = get_slot_penalty(config, points, week_index, 0, 0);
+	for (int shift = 0; shift < SHIFT_COUNT; ++shift) {
+		penalty_t const *const penalty = &slot_penalties[shift*config->person_count + week->shifts[shift]];
+		value += penalty->value;
+		failures += penalty->failure_count;
+#if COLLECT_STATS
+		for (int i = 0; i < POINTS_COUNT; ++i) {
+			STATS_COUNT_POINTS(i, penalty->points_counts[i]);
+		}
+#endif
 	}
-	fprintf(fp, "</tr>");
-	for (int person_index = 0; person_index < config->person_count; ++person_index) {
-		fprintf(fp, "<tr><td style=\"white-space: nowrap\">%s</td>\n", config->people[person_index].name);
-		for (int week_index = 0; week_index < config->week_count; ++week_index) {
-			week_t const *const week = &rota->weeks[week_index];
-			bool const is_ward_week = (week->shifts[SHIFT_WARD_WEEK] == person_index);
-			bool const mark_ward_week = is_disliked_ward_week(config, week_index, person_index);
-			for (int weekday_index = 0; weekday_index < 7; ++weekday_index) {
-				int const rota_day_index = 7*week_index + weekday_index;
-				int const person_on_call = (weekday_index < 5) ? week->shifts[weekday_index] : week->shifts[SHIFT_ON_CALL_WEEKEND];
-				bool const mark_on_call = is_disliked_on_call_day(config, rota_day_index, person_index);
-				char const *extra = "";
-				char const *contents = "";
-				if (person_index == person_on_call) {
-					extra = " style=\"background-color:red\"";
-					if (mark_on_call) {
-						contents = "x";
-					}
-				} else if (weekday_index < 5 && is_ward_week) {
-					extra = " style=\"background-color:yellow\"";
-					if (mark_ward_week) {
-						contents = "x";
-					}
-				} else if (is_holiday_day(config, rota_day_index, person_index)) {
-					extra = " style=\"background-color:grey\"";
-				} else if (is_bank_holiday(config, rota_day_index)) {
-					extra = " style=\"background-color:lightblue\"";
-				} else if (weekday_index >= 5) {
-					extra = " style=\"background-color:cyan\"";
+
+	// checks between shifts
+	for (int day_index = 0; day_index < 7; ++day_index) {
+		int const person_on_call = week->shifts[(day_index < 5) ? day_index : SHIFT_ON_CALL_WEEKEND];
+		if (day_index < 5 && person_on_call == person_on_ward) {
+			value += points->values[POINTS_SHIFT_OVERLAP];
+			STATS_COUNT_POINTS(POINTS_SHIFT_OVERLAP, 1);
+			++failures;
+		}
+		if (day_index == 0 && person_on_ward == person_on_call_yesterday) {
+			value += points->values[POINTS_WORK_FOLLOWING_ON_CALL];
+			STATS_COUNT_POINTS(POINTS_WORK_FOLLOWING_ON_CALL, 1);
+			++failures;
+		}
+		if (day_index <= 5) {
+			if (person_on_call == person_on_call_yesterday) {
+				value += points->values[POINTS_WORK_FOLLOWING_ON_CALL];
+				STATS_COUNT_POINTS(POINTS_WORK_FOLLOWING_ON_CALL, 1);
+				++failures;
+			}
+			for (int i = 0; i < day_index; ++i) {
+				if (week->shifts[i] == person_on_call) {
+					value += points->values[POINTS_MULTIPLE_ON_CALLS_PER_WEEK];
+					STATS_COUNT_POINTS(POINTS_MULTIPLE_ON_CALLS_PER_WEEK, 1);
+					break;
 				}
-				fprintf(fp, "<td%s>%s</td>\n", extra, contents);
 			}
 		}
-		fprintf(fp, "</tr>");
+		if (day_index == 0 && week_index > 0 && rota->weeks[week_index - 1].shifts[SHIFT_WARD_WEEK] == person_on_ward) {
+			value += points->values[POINTS_WARD_WEEK_ONE_WEEK_AGO];
+			STATS_COUNT_POINTS(POINTS_WARD_WEEK_ONE_WEEK_AGO, 1);
+		}
+		if (day_index == 0 && week_index > 1 && rota->weeks[week_index - 2].shifts[SHIFT_WARD_WEEK] == person_on_ward) {
+			value += points->values[POINTS_WARD_WEEK_TWO_WEEKS_AGO];
+			STATS_COUNT_POINTS(POINTS_WARD_WEEK_TWO_WEEKS_AGO, 1);
+		}
+		person_on_call_yesterday = person_on_call;
 	}
-	fprintf(fp, "</table>\n");
-
-	fprintf(fp, "<h1>Summary</h1>\n<table>\n");
-	fprintf(fp, "<tr>\n\
-<th rowspan=\"2\">Name</th>\n\
-<th colspan=\"2\">Full Time</th>\n\
-<th colspan=\"3\">Input Bias</th>\n\
-<th colspan=\"3\">Rota Target</th>\n\
-<th colspan=\"3\">Rota Result</th>\n\
-<th colspan=\"3\">Output Bias</th>\n\
-</tr>\n\
-");
-	fprintf(fp, "<tr>\n\
-<th>Input</th><th>Effective</th>\n\
-<th>On Call Days (Bank Hols)</th><th>On Call Weekends</th><th>Ward Weeks</th>\n\
-<th>On Call Days (Bank Hols)</th><th>On Call Weekends</th><th>Ward Weeks</th>\n\
-<th>On Call Days (Bank Hols)</th><th>On Call Weekends</th><th>Ward Weeks</th>\n\
-<th>On Call Days (Bank Hols)</th><th>On Call Weekends</th><th>Ward Weeks</th>\n\
-</tr>\n\
-");
-	for (int person_index = 0; person_index < config->person_count; ++person_index) {
-		person_config_t const *person_config = &config->people[person_index];
-		person_score_t const *person_score = &score->people[person_index];
-		fprintf(fp, "<tr><td>%s</td>\n", person_config->name);
-		fprintf(fp, "<td>%.3f</td><td>%.3f</td>", person_config->full_time_amount, person_config->effective_full_time_amount);
-		fprintf(fp, "<td>%f (%f)</td><td>%f</td><td>%f</td>",
-			person_config->on_call_day_bias,
-			person_config->bank_holiday_bias,
-			person_config->on_call_weekend_bias,
-			person_config->ward_week_bias);
-		fprintf(fp, "<td>%.1f (%.1f)</td><td>%.1f</td><td>%.1f</td>",
-			person_config->target_on_call_days,
-			person_config->target_on_call_bank_holidays,
-			person_config->target_on_call_weekends,
-			person_config->target_ward_weeks);
-		fprintf(fp, "<td>%d (%d)</td><td>%d</td><td>%d</td>",
-			person_score->total_on_call_days,
-			person_score->total_on_call_bank_holidays,
-			person_score->total_on_call_weekends,
-			person_score->total_ward_weeks);
-		fprintf(fp, "<td>%.1f (%.1f)</td><td>%.1f</td><td>%.1f</td>",
-			person_score->remainder_on_call_days,
-			person_score->remainder_on_call_bank_holidays,
-			person_score->remainder_on_call_weekends,
-			person_score->remainder_ward_weeks);
-		fprintf(fp, "</tr>\n");
+	if (week->shifts[SHIFT_ON_CALL_WEEKEND] == person_on_ward) {
+		value += points->values[POINTS_ON_CALL_WEEKEND_FOLLOWS_WARD_WEEK];
+		STATS_COUNT_POINTS(POINTS_ON_CALL_WEEKEND_FOLLOWS_WARD_WEEK, 1);
 	}
-	fprintf(fp, "</table>\n");
-
-	fprintf(fp, "</body>\n</html>\n");
-	fclose(fp);
-
-	printf("written output to \"%s\"\n", filename);
+	*failure_count = failures;
+	return value;
 }
 
-void print_rota_csv(char const *filename, config_t const *config, rota_t const *rota)
+bool is_working_week(week_t const *week, int person)
 {
-	FILE *const fp = fopen(filename, "w");
-	if (!fp) {
-		fprintf(stderr, "failed to open \"%s\" for writing!\n", filename);
-		exit(-1);
+	for (int shift = 0; shift < SHIFT_COUNT; ++shift) {
+		if (week->shifts[shift] == person) {
+			return true;
+		}
 	}
+	return false;
+}
 
-	for (int week_index = 0; week_index < config->week_count; ++week_index) {
-		fprintf(fp, "Date");
-		for (int weekday_index = 0; weekday_index < 7; ++weekday_index) {
-			int const rota_day_index = 7*week_index + weekday_index;
-			time_t const day_time = config->first_day + rota_day_index*TIME_DELTA_DAY;
-			tm_t *const tm = localtime(&day_time);
-			fprintf(fp, ",%d/%d/%d", tm->tm_mday, tm->tm_mon + 1, tm->tm_year + EPOCH_YEAR);
+int get_last_work_day_in_week(week_t const *week, int week_index, int person)
+{
+	int weekday_index = -1;
+	if (week->shifts[SHIFT_ON_CALL_WEEKEND] == person) {
+		weekday_index = 6;
+	} else if (week->shifts[SHIFT_WARD_WEEK] == person) {
+		weekday_index = 4;
+	} else {
+		for (int i = 0; i < 5; ++i) {
+			if (week->shifts[i] == person) {
+				weekday_index = i;
+			}
 		}
-		fprintf(fp, "\n");
-
-		week_t const *const week = &rota->weeks[week_index];
+	}
+	return (weekday_index < 0) ? -1 : (7*week_index + weekday_index);
+}
 
-		fprintf(fp, "On Call");
-		for (int weekday_index = 0; weekday_index < 7; ++weekday_index) {
-			int const person_on_call = week->shifts[(weekday_index < 5) ? weekday_index : SHIFT_ON_CALL_WEEKEND];
-			fprintf(fp, ",%s", config->people[person_on_call].name);
+float score_person_week_days_off(
+	points_t const *points,
+	week_t const *week,
+	int week_index,
+	int person,
+	int *last_work_day)
+{
+	// mirrors the days off checks in score_rota for a single person
+	float value = 0.f;
+	for (int day_index = 0; day_index < 7; ++day_index) {
+		int const rota_day_index = week_index*7 + day_index;
+		if (day_index < 5) {
+			bool const on_call = (week->shifts[day_index] == person);
+			bool const on_ward = (week->shifts[SHIFT_WARD_WEEK] == person);
+			if (on_call) {
+				value += get_days_off_score(points, rota_day_index - *last_work_day);
+			}
+			if (day_index == 0 && on_ward) {
+				value += get_days_off_score(points, rota_day_index - *last_work_day);
+			}
+			if (on_call || on_ward) {
+				*last_work_day = rota_day_index;
+			}
+		} else if (week->shifts[SHIFT_ON_CALL_WEEKEND] == person) {
+			if (day_index == 5) {
+				value += get_days_off_score(points, rota_day_index - *last_work_day);
+			}
+			*last_work_day = rota_day_index;
 		}
-		fprintf(fp, "\n");
+	}
+	return value;
+}
 
-		fprintf(fp, "Ward");
-		int const person_on_ward = week->shifts[SHIFT_WARD_WEEK];
-		for (int weekday_index = 0; weekday_index < 5; ++weekday_index) {
-			fprintf(fp, ",%s", config->people[person_on_ward].name);
+int get_last_work_day_before(config_t const *config, rota_t const *rota, int person, int week_index, int *week_reads)
+{
+	for (int i = week_index - 1; i >= 0; --i) {
+		int const day = get_last_work_day_in_week(&rota->weeks[i], i, person);
+		if (day >= 0) {
+			*week_reads += week_index - i;
+			return day;
 		}
-		fprintf(fp, ",,\n");
+	}
+	*week_reads += week_index;
+	return config->people[person].first_day - 1;
+}
 
-		fprintf(fp, ",,,,,,,\n");
+int get_last_ward_week_before(config_t const *config, rota_t const *rota, int person, int week_index, int *week_reads)
+{
+	for (int i = week_index - 1; i >= 0; --i) {
+		if (rota->weeks[i].shifts[SHIFT_WARD_WEEK] == person) {
+			*week_reads += week_index - i;
+			return i;
+		}
 	}
+	*week_reads += week_index;
+	return config->people[person].first_day/7 - 1;
+}
 
-	fclose(fp);
+double score_person_chain(
+	config_t const *config,
+	points_t const *points,
+	rota_t const *rota,
+	int person,
+	int const *week_indices,
+	int count,
+	bool include_ward_weeks,
+	int *week_reads)
+{
+	// score the gaps that can change when this person's shifts in these weeks
+	// change, each once; the weeks are in increasing order, and a run of them
+	// with no work between is scored as one stretch.  The weeks looked at are
+	// added to week_reads, as a measure of the work done
+	person_config_t const *const person_config = &config->people[person];
+	double value = 0.0;
+
+	// days off: from the last work day before each run up to the first work day after it
+	int last_work_day = 0;
+	for (int i = 0; i < count; ++i) {
+		int const week_index = week_indices[i];
+		if (i > 0) {
+			int next_week_index = week_indices[i - 1] + 1;
+			while (next_week_index < week_index && !is_working_week(&rota->weeks[next_week_index], person)) {
+				++next_week_index;
+			}
+			*week_reads += next_week_index - week_indices[i - 1];
+			if (next_week_index < week_index) {
+				value += score_person_week_days_off(points, &rota->weeks[next_week_index], next_week_index, person, &last_work_day);
+				last_work_day = get_last_work_day_before(config, rota, person, week_index, week_reads);
+			}
+		} else {
+			last_work_day = get_last_work_day_before(config, rota, person, week_index, week_reads);
+		}
+		value += score_person_week_days_off(points, &rota->weeks[week_index], week_index, person, &last_work_day);
+	}
+	int next_week_index = week_indices[count - 1] + 1;
+	while (next_week_index < config->week_count && !is_working_week(&rota->weeks[next_week_index], person)) {
+		++next_week_index;
+	}
+	*week_reads += next_week_index - week_indices[count - 1];
+	if (next_week_index < config->week_count) {
+		value += score_person_week_days_off(points, &rota->weeks[next_week_index], next_week_index, person, &last_work_day);
+	} else {
+		value += get_days_off_score(points, person_config->last_day - last_work_day);
+	}
 
-	printf("written output to \"%s\"\n", filename);
+	// ward weeks: from the last ward week before each run up to the next one after it
+	if (!include_ward_weeks) {
+		return value;
+	}
+	int last_ward_week = 0;
+	for (int i = 0; i < count; ++i) {
+		int const week_index = week_indices[i];
+		if (i > 0) {
+			next_week_index = week_indices[i - 1] + 1;
+			while (next_week_index < week_index && rota->weeks[next_week_index].shifts[SHIFT_WARD_WEEK] != person) {
+				++next_week_index;
+			}
+			*week_reads += next_week_index - week_indices[i - 1];
+			if (next_week_index < week_index) {
+				value += get_no_ward_week_score(points, next_week_index - last_ward_week);
+				last_ward_week = get_last_ward_week_before(config, rota, person, week_index, week_reads);
+			}
+		} else {
+			last_ward_week = get_last_ward_week_before(config, rota, person, week_index, week_reads);
+		}
+		if (rota->weeks[week_index].shifts[SHIFT_WARD_WEEK] == person) {
+			value += get_no_ward_week_score(points, week_index - last_ward_week);
+			last_ward_week = week_index;
+		}
+	}
+	next_week_index = week_indices[count - 1] + 1;
+	while (next_week_index < config->week_count && rota->weeks[next_week_index].shifts[SHIFT_WARD_WEEK] != person) {
+		++next_week_index;
+	}
+	*week_reads += next_week_index - week_indices[count - 1];
+	if (next_week_index < config->week_count) {
+		value += get_no_ward_week_score(points, next_week_index - last_ward_week);
+	} else {
+		value += get_no_ward_week_score(points, person_config->last_day/7 - last_ward_week);
+	}
+	return value;
 }
 
-void mutate_random_reassign(
-	config_t const *config,
-	rota_t const *rota_in,
-	rota_t *rota_out)
+float score_person_fairness(
+	person_config_t const *person_config,
+	points_t const *points,
+	person_score_t const *person_score)
 {
-	memcpy(rota_out, rota_in, sizeof(rota_t));
+	// mirrors the distribution checks at the end of score_rota
+	float const remainder_on_call_days = person_score->total_on_call_days + person_config->on_call_day_bias - person_config->target_on_call_days;
+	float const remainder_on_call_weekends = person_score->total_on_call_weekends + person_config->on_call_weekend_bias - person_config->target_on_call_weekends;
+	float const remainder_ward_weeks = person_score->total_ward_weeks + person_config->ward_week_bias - person_config->target_ward_weeks;
+	float const remainder_on_call_bank_holidays = person_score->total_on_call_bank_holidays + person_config->bank_holiday_bias - person_config->target_on_call_bank_holidays;
+
+	float value = 0.f;
+	value += points->values[POINTS_ON_CALL_DAY_DIFFERENCE]*sqr(remainder_on_call_days);
+	value += points->values[POINTS_ON_CALL_WEEKEND_DIFFERENCE]*sqr(remainder_on_call_weekends);
+	value += points->values[POINTS_WARD_WEEK_DIFFERENCE]*sqr(remainder_ward_weeks);
+	value += points->values[POINTS_ON_CALL_BANK_HOLIDAY_DIFFERENCE]*sqr(remainder_on_call_bank_holidays);
+	STATS_COUNT_POINTS(POINTS_ON_CALL_DAY_DIFFERENCE, remainder_on_call_days != 0.f);
+	STATS_COUNT_POINTS(POINTS_ON_CALL_WEEKEND_DIFFERENCE, remainder_on_call_weekends != 0.f);
+	STATS_COUNT_POINTS(POINTS_WARD_WEEK_DIFFERENCE, remainder_ward_weeks != 0.f);
+	STATS_COUNT_POINTS(POINTS_ON_CALL_BANK_HOLIDAY_DIFFERENCE, remainder_on_call_bank_holidays != 0.f);
+	return value;
+}
 
-	int const week = rota_rand(config->week_count);
-	int const shift = rota_rand(SHIFT_COUNT);
+size_t get_delta_arrays_size(config_t const *config)
+{
+	int const week_count = config->week_count;
+	int const person_count = config->person_count;
+	return (week_count + 2*person_count)*sizeof(double)
+		+ person_count*sizeof(person_score_t)
+		+ 3*week_count*sizeof(int);
+}
 
-	rota_out->weeks[week].shifts[shift] = rota_rand(config->person_count);
+delta_t *alloc_delta(config_t const *config)
+{
+	// one block for the tracker and its arrays
+	int const week_count = config->week_count;
+	int const person_count = config->person_count;
+	size_t const check_score_size = CHECK_DELTA_SCORE ? get_score_size(person_count) : 0;
+	delta_t *const delta = (delta_t *)calloc(1, sizeof(delta_t) + get_delta_arrays_size(config) + check_score_size);
+	delta->week_values = (double *)(delta + 1);
+	delta->chain_values = delta->week_values + week_count;
+	delta->fairness_values = delta->chain_values + person_count;
+	delta->people = (person_score_t *)(delta->fairness_values + person_count);
+	delta->week_failure_counts = (int *)(delta->people + person_count);
+	delta->failing_weeks = delta->week_failure_counts + week_count;
+	delta->failing_week_indices = delta->failing_weeks + week_count;
+	if (CHECK_DELTA_SCORE) {
+		delta->check_score = (score_t *)(delta->failing_week_indices + week_count);
+		delta->check_score->person_count = person_count;
+	}
+	return delta;
 }
 
-void mutate_random_swap(
+void delta_init(
+	delta_t *delta,
 	config_t const *config,
-	rota_t const *rota_in,
-	rota_t *rota_out)
+	points_t const *points,
+	rota_t *rota)
 {
-	memcpy(rota_out, rota_in, sizeof(rota_t));
+	delta->config = config;
+	delta->points = points;
+	delta->rota = rota;
+	delta->value = 0.0;
+	delta->failure_count = 0;
+	delta->failing_week_count = 0;
+	delta->journal_int_count = 0;
+	delta->journal_double_count = 0;
+	memset(delta->people, 0, config->person_count*sizeof(person_score_t));
 
-	int const week_a = rota_rand(config->week_count);
-	int const shift_a = rota_rand(SHIFT_COUNT);
+	for (int week_index = 0; week_index < config->week_count; ++week_index) {
+		int failure_count;
+		delta->week_values[week_index] = score_week_local(config, points, rota, week_index, &failure_count);
+		delta->week_failure_counts[week_index] = failure_count;
+		delta->value += delta->week_values[week_index];
+		delta->failure_count += failure_count;
+		delta->failing_week_indices[week_index] = -1;
+		if (failure_count != 0 && config->is_active_week[week_index]) {
+			delta->failing_week_indices[week_index] = delta->failing_week_count;
+			delta->failing_weeks[delta->failing_week_count++] = week_index;
+		}
 
-	int const week_b = rota_rand(config->week_count);
-	int shift_b = shift_a;
-	if (shift_a < 5) {
-		shift_b = rota_rand(5);
+		week_t const *const week = &rota->weeks[week_index];
+		for (int day_index = 0; day_index < 5; ++day_index) {
+			person_score_t *const person_score = &delta->people[week->shifts[day_index]];
+			++person_score->total_on_call_days;
+			if (is_bank_holiday(config, 7*week_index + day_index)) {
+				++person_score->total_on_call_bank_holidays;
+			}
+		}
+		++delta->people[week->shifts[SHIFT_ON_CALL_WEEKEND]].total_on_call_weekends;
+		++delta->people[week->shifts[SHIFT_WARD_WEEK]].total_ward_weeks;
 	}
 
-	rota_out->weeks[week_a].shifts[shift_a] = rota_in->weeks[week_b].shifts[shift_b];
-	rota_out->weeks[week_b].shifts[shift_b] = rota_in->weeks[week_a].shifts[shift_a];
-}
-
-#define MAX_LINE_LENGTH			(16*1024)
+	for (int person = 0; person < config->person_count; ++person) {
+		person_config_t const *const person_config = &config->people[person];
 
-char *scan_for_next_column(char *p)
-{
-	// skip to delimiter
-	if (p) {
-		for (;;) {
-			char const c = *p;
-			if (c ==  ',') {
-				*p = '\0';
-				++p;
-				break;
-			}
-			if (c == '\n' || c == '\r' || c == '\0') {
-				*p = '\0';
-				p = NULL;
-				break;
+		// full chains, same order as the sweep in score_rota
+		int last_work_day = person_config->first_day - 1;
+		int last_ward_week = person_config->first_day/7 - 1;
+		double chain_value = 0.0;
+		for (int week_index = 0; week_index < config->week_count; ++week_index) {
+			week_t const *const week = &rota->weeks[week_index];
+			chain_value += score_person_week_days_off(points, week, week_index, person, &last_work_day);
+			if (week->shifts[SHIFT_WARD_WEEK] == person) {
+				chain_value += get_no_ward_week_score(points, week_index - last_ward_week);
+				last_ward_week = week_index;
 			}
-			++p;
 		}
+		chain_value += get_days_off_score(points, person_config->last_day - last_work_day);
+		chain_value += get_no_ward_week_score(points, person_config->last_day/7 - last_ward_week);
+		delta->chain_values[person] = chain_value;
+		delta->value += chain_value;
+
+		delta->fairness_values[person] = score_person_fairness(person_config, points, &delta->people[person]);
+		delta->value += delta->fairness_values[person];
 	}
-	return p;
 }
 
-time_t parse_date(char const *str)
+void delta_set_int(delta_t *delta, int *addr, int value)
 {
-	int day,month,year;
-	if (sscanf(str, "%d/%d/%d", &day, &month, &year) != 3) {
-		fprintf(stderr, "failed to parse date \"%s\"!\n", str);
+	if (delta->journal_int_count == MAX_JOURNAL_LENGTH) {
+		fprintf(stderr, "internal error: delta journal is full!\n");
 		exit(-1);
 	}
+	journal_int_t *const entry = &delta->journal_ints[delta->journal_int_count++];
+	entry->addr = addr;
+	entry->value = *addr;
+	*addr = value;
+}
 
-	tm_t tm;
-	memset(&tm, 0, sizeof(tm_t));
-	tm.tm_year = year - EPOCH_YEAR;
-	tm.tm_mday = day;
-	tm.tm_mon = month - 1;
-	tm.tm_hour = 12;
-	tm.tm_isdst = 1;
-
-	time_t const t = mktime(&tm);
-	if (t == INVALID_TIME) {
-		fprintf(stderr, "failed to convert date \"%s\"!\n", str);
+void delta_set_double(delta_t *delta, double *addr, double value)
+{
+	if (delta->journal_double_count == MAX_JOURNAL_LENGTH) {
+		fprintf(stderr, "internal error: delta journal is full!\n");
 		exit(-1);
 	}
-	return t;
+	journal_double_t *const entry = &delta->journal_doubles[delta->journal_double_count++];
+	entry->addr = addr;
+	entry->value = *addr;
+	*addr = value;
 }
 
-int find_or_add_person(config_t *config, char const *name)
+void delta_commit(delta_t *delta)
 {
-	if (*name == '\0') {
-		fprintf(stderr, "name must not be empty!\n");
+	delta->journal_int_count = 0;
+	delta->journal_double_count = 0;
+}
+
+void delta_rollback(delta_t *delta)
+{
+	while (delta->journal_int_count > 0) {
+		journal_int_t const *const entry = &delta->journal_ints[--delta->journal_int_count];
+		*entry->addr = entry->value;
+	}
+	while (delta->journal_double_count > 0) {
+		journal_double_t const *const entry = &delta->journal_doubles[--delta->journal_double_count];
+		*entry->addr = entry->value;
+	}
+}
+
+void delta_update_failing_week(delta_t *delta, int week_index)
+{
+	// keep active weeks with failures in a list for repairs to pick from,
+	// removing by swapping the last entry into the gap
+	int const index = delta->failing_week_indices[week_index];
+	bool const is_failing = delta->week_failure_counts[week_index] != 0 && delta->config->is_active_week[week_index];
+	if (is_failing && index == -1) {
+		delta_set_int(delta, &delta->failing_weeks[delta->failing_week_count], week_index);
+		delta_set_int(delta, &delta->failing_week_indices[week_index], delta->failing_week_count);
+		delta_set_int(delta, &delta->failing_week_count, delta->failing_week_count + 1);
+	} else if (!is_failing && index != -1) {
+		int const last = delta->failing_weeks[delta->failing_week_count - 1];
+		delta_set_int(delta, &delta->failing_weeks[index], last);
+		delta_set_int(delta, &delta->failing_week_indices[last], index);
+		delta_set_int(delta, &delta->failing_week_indices[week_index], -1);
+		delta_set_int(delta, &delta->failing_week_count, delta->failing_week_count - 1);
+	}
+}
+
+void delta_rescore_week(delta_t *delta, int week_index)
+{
+	if (week_index < delta->config->week_count) {
+		int failure_count;
+		double const value = score_week_local(delta->config, delta->points, delta->rota, week_index, &failure_count);
+		++delta->week_reads;
+		delta_set_double(delta, &delta->value, delta->value + value - delta->week_values[week_index]);
+		delta_set_double(delta, &delta->week_values[week_index], value);
+		delta_set_int(delta, &delta->failure_count, delta->failure_count + failure_count - delta->week_failure_counts[week_index]);
+		delta_set_int(delta, &delta->week_failure_counts[week_index], failure_count);
+		delta_update_failing_week(delta, week_index);
+	}
+}
+
+void delta_update_total(delta_t *delta, int *total, int change)
+{
+	delta_set_int(delta, total, *total + change);
+}
+
+void delta_rescore_fairness(delta_t *delta, int person)
+{
+	double const value = score_person_fairness(&delta->config->people[person], delta->points, &delta->people[person]);
+	delta_set_double(delta, &delta->value, delta->value + value - delta->fairness_values[person]);
+	delta_set_double(delta, &delta->fairness_values[person], value);
+}
+
+void check_delta(delta_t const *delta)
+{
+	score_t *const score = delta->check_score;
+	score_rota(delta->config, delta->points, delta->rota, score);
+	double const tolerance = .01 + 1e-5*fabs(score->value);
+	if (fabs(delta->value - score->value) > tolerance || MIN(delta->failure_count, MAX_FAILURE_COUNT) != score->failure_count) {
+		fprintf(stderr, "internal error: delta score %f (%d failures) does not match full score %f (%d failures)!\n",
+			delta->value, delta->failure_count, score->value, score->failure_count);
+		exit(-1);
+	}
+	int failing_week_count = 0;
+	for (int i = 0; i < delta->config->active_week_count; ++i) {
+		int const week_index = delta->config->active_weeks[i];
+		if (delta->week_failure_counts[week_index] != 0) {
+			if (delta->failing_weeks[delta->failing_week_indices[week_index]] != week_index) {
+				fprintf(stderr, "internal error: failing week %d is not listed!\n", week_index);
+				exit(-1);
+			}
+			++failing_week_count;
+		}
+	}
+	if (failing_week_count != delta->failing_week_count) {
+		fprintf(stderr, "internal error: %d failing weeks listed but %d found!\n", delta->failing_week_count, failing_week_count);
 		exit(-1);
 	}
+}
 
-	int person = 0;
-	for (;;) {
-		if (person == config->person_count) {
-			person_config_t *const info = &config->people[person];
-			strcpy(info->name, name);
-			info->full_time_amount = 1.f;
-			info->first_day = 0;
-			info->last_day = config->week_count*7 - 1;
-			info->effective_full_time_amount = 1.f;
-			++config->person_count;
+void delta_move_totals(delta_t *delta, int week_index, int shift, int old_person, int person)
+{
+	int *old_total, *new_total;
+	switch (shift) {
+		case SHIFT_ON_CALL_WEEKEND:
+			old_total = &delta->people[old_person].total_on_call_weekends;
+			new_total = &delta->people[person].total_on_call_weekends;
 			break;
-		}
-		if (strcmp(config->people[person].name, name) == 0) {
+
+		case SHIFT_WARD_WEEK:
+			old_total = &delta->people[old_person].total_ward_weeks;
+			new_total = &delta->people[person].total_ward_weeks;
+			break;
+
+		default:
+			old_total = &delta->people[old_person].total_on_call_days;
+			new_total = &delta->people[person].total_on_call_days;
+			if (is_bank_holiday(delta->config, 7*week_index + shift)) {
+				delta_update_total(delta, &delta->people[old_person].total_on_call_bank_holidays, -1);
+				delta_update_total(delta, &delta->people[person].total_on_call_bank_holidays, 1);
+			}
 			break;
-		}
-		++person;
 	}
-	return person;
+	delta_update_total(delta, old_total, -1);
+	delta_update_total(delta, new_total, 1);
 }
 
-enum
+void delta_reassign(delta_t *delta, int week_index, int shift, int person)
 {
-	CATEGORY_HOLIDAY,
-	CATEGORY_CANNOT_ON_CALL_DAY,
-	CATEGORY_CANNOT_ON_CALL_DAY_ALWAYS,
-	CATEGORY_CANNOT_WARD_WEEK,
-	CATEGORY_DISLIKE_ON_CALL_DAY,
-	CATEGORY_DISLIKE_ON_CALL_DAY_ALWAYS,
-	CATEGORY_DISLIKE_WARD_WEEK,
+	config_t const *const config = delta->config;
+	points_t const *const points = delta->points;
+	rota_t *const rota = delta->rota;
+	int *const slot = &rota->weeks[week_index].shifts[shift];
+	int const old_person = *slot;
+	if (old_person == person) {
+		return;
+	}
+
+	// chains before the change, ward week gaps only change with the ward shift
+	STATS_BEGIN(chains);
+	bool const is_ward_shift = (shift == SHIFT_WARD_WEEK);
+	double const old_chain_before = score_person_chain(config, points, rota, old_person, &week_index, 1, is_ward_shift, &delta->week_reads);
+	double const new_chain_before = score_person_chain(config, points, rota, person, &week_index, 1, is_ward_shift, &delta->week_reads);
+
+	delta_set_int(delta, slot, person);
+
+	// chains after the change
+	double const old_chain_after = score_person_chain(config, points, rota, old_person, &week_index, 1, is_ward_shift, &delta->week_reads);
+	double const new_chain_after = score_person_chain(config, points, rota, person, &week_index, 1, is_ward_shift, &delta->week_reads);
+	delta_set_double(delta, &delta->chain_values[old_person], delta->chain_values[old_person] + old_chain_after - old_chain_before);
+	delta_set_double(delta, &delta->chain_values[person], delta->chain_values[person] + new_chain_after - new_chain_before);
+	delta_set_double(delta, &delta->value, delta->value + (old_chain_after - old_chain_before) + (new_chain_after - new_chain_before));
+	STATS_END(chains, SECTION_CHAINS);
+
+	// weeks that look at this shift
+	STATS_BEGIN(weeks);
+	delta_rescore_week(delta, week_index);
+	if (shift == SHIFT_ON_CALL_WEEKEND || shift == SHIFT_WARD_WEEK) {
+		delta_rescore_week(delta, week_index + 1);
+	}
+	if (shift == SHIFT_WARD_WEEK) {
+		delta_rescore_week(delta, week_index + 2);
+	}
+	STATS_END(weeks, SECTION_WEEKS);
+
+	// totals
+	STATS_BEGIN(fairness);
+	delta_move_totals(delta, week_index, shift, old_person, person);
+	delta_rescore_fairness(delta, old_person);
+	delta_rescore_fairness(delta, person);
+	STATS_END(fairness, SECTION_FAIRNESS);
+
+#if CHECK_DELTA_SCORE
+	check_delta(delta);
+#endif
+}
+
+#define MAX_REASSIGN_SLOTS		32
+
+void delta_reassign_slots(delta_t *delta, int const *slots, int const *people, int count)
+{
+	// reassign several different shifts at once, scoring each chain, week and
+	// person they touch once rather than once per shift
+	config_t const *const config = delta->config;
+	points_t const *const points = delta->points;
+	rota_t *const rota = delta->rota;
+
+	// the people losing or gaining a shift, sorted by person then week
+	int chain_people[2*MAX_REASSIGN_SLOTS];
+	int chain_weeks[2*MAX_REASSIGN_SLOTS];
+	bool chain_wards[2*MAX_REASSIGN_SLOTS];
+	int chain_count = 0;
+	for (int i = 0; i < count; ++i) {
+		int const week_index = slots[i]/SHIFT_COUNT;
+		int const shift = slots[i] % SHIFT_COUNT;
+		int const old_person = rota->weeks[week_index].shifts[shift];
+		if (old_person == people[i]) {
+			continue;
+		}
+		for (int j = 0; j < 2; ++j) {
+			int const person = j ? people[i] : old_person;
+			int k = chain_count;
+			while (k > 0 && (chain_people[k - 1] > person || (chain_people[k - 1] == person && chain_weeks[k - 1] > week_index))) {
+				--k;
+			}
+			if (k > 0 && chain_people[k - 1] == person && chain_weeks[k - 1] == week_index) {
+				chain_wards[k - 1] |= (shift == SHIFT_WARD_WEEK);
+				continue;
+			}
+			memmove(&chain_people[k + 1], &chain_people[k], (chain_count - k)*sizeof(int));
+			memmove(&chain_weeks[k + 1], &chain_weeks[k], (chain_count - k)*sizeof(int));
+			memmove(&chain_wards[k + 1], &chain_wards[k], (chain_count - k)*sizeof(bool));
+			chain_people[k] = person;
+			chain_weeks[k] = week_index;
+			chain_wards[k] = (shift == SHIFT_WARD_WEEK);
+			++chain_count;
+		}
+	}
+	if (chain_count == 0) {
+		return;
+	}
+
+	// chains before the change, one stretch per person over their weeks
+	STATS_BEGIN(chains);
+	int group_starts[2*MAX_REASSIGN_SLOTS + 1];
+	bool group_wards[2*MAX_REASSIGN_SLOTS];
+	double group_values[2*MAX_REASSIGN_SLOTS];
+	int group_count = 0;
+	for (int i = 0; i < chain_count; ++i) {
+		if (i == 0 || chain_people[i] != chain_people[i - 1]) {
+			group_starts[group_count] = i;
+			group_wards[group_count++] = false;
+		}
+		group_wards[group_count - 1] |= chain_wards[i];
+	}
+	group_starts[group_count] = chain_count;
+	for (int i = 0; i < group_count; ++i) {
+		int const first = group_starts[i];
+		group_values[i] = score_person_chain(config, points, rota, chain_people[first], &chain_weeks[first], group_starts[i + 1] - first, group_wards[i], &delta->week_reads);
+	}
+
+	// change the shifts and the totals
+	int weeks[3*MAX_REASSIGN_SLOTS];
+	int week_count = 0;
+	for (int i = 0; i < count; ++i) {
+		int const week_index = slots[i]/SHIFT_COUNT;
+		int const shift = slots[i] % SHIFT_COUNT;
+		int *const slot = &rota->weeks[week_index].shifts[shift];
+		int const old_person = *slot;
+		if (old_person == people[i]) {
+			continue;
+		}
+		delta_set_int(delta, slot, people[i]);
+		delta_move_totals(delta, week_index, shift, old_person, people[i]);
+		int const last_week_index = week_index + ((shift == SHIFT_WARD_WEEK) ? 2 : (shift == SHIFT_ON_CALL_WEEKEND) ? 1 : 0);
+		for (int j = week_index; j <= last_week_index; ++j) {
+			int k = 0;
+			while (k < week_count && weeks[k] != j) {
+				++k;
+			}
+			if (k == week_count) {
+				weeks[week_count++] = j;
+			}
+		}
+	}
+
+	// chains after the change
+	for (int i = 0; i < group_count; ++i) {
+		int const first = group_starts[i];
+		int const person = chain_people[first];
+		double const change = score_person_chain(config, points, rota, person, &chain_weeks[first], group_starts[i + 1] - first, group_wards[i], &delta->week_reads) - group_values[i];
+		delta_set_double(delta, &delta->chain_values[person], delta->chain_values[person] + change);
+		delta_set_double(delta, &delta->value, delta->value + change);
+	}
+	STATS_END(chains, SECTION_CHAINS);
+
+	// weeks that look at these shifts
+	STATS_BEGIN(weeks);
+	for (int i = 0; i < week_count; ++i) {
+		delta_rescore_week(delta, weeks[i]);
+	}
+	STATS_END(weeks, SECTION_WEEKS);
+
+	// fairness of everyone whose totals moved
+	STATS_BEGIN(fairness);
+	for (int i = 0; i < group_count; ++i) {
+		delta_rescore_fairness(delta, chain_people[group_starts[i]]);
+	}
+	STATS_END(fairness, SECTION_FAIRNESS);
+
+#if CHECK_DELTA_SCORE
+	check_delta(delta);
+#endif
+}
+
+/*
+	Buffered output.
+
+	Reports are assembled in one large buffer that goes to the file in a few
+	big writes.  Plain strings are copied straight in, so only cells with
+	numbers pay for a format.
+*/
+
+#define WRITER_BUFFER_SIZE			(1024*1024)
+
+typedef struct
+{
+	FILE *fp;
+	size_t size;
+	char buffer[WRITER_BUFFER_SIZE];
+} writer_t;
+
+writer_t *open_writer(char const *filename)
+{
+	FILE *const fp = fopen(filename, "w");
+	if (!fp) {
+		fprintf(stderr, "failed to open \"%s\" for writing!\n", filename);
+		exit(-1);
+	}
+	writer_t *const writer = (writer_t *)malloc(sizeof(writer_t));
+	writer->fp = fp;
+	writer->size = 0;
+	return writer;
+}
+
+void flush_writer(writer_t *writer)
+{
+	fwrite(writer->buffer, 1, writer->size, writer->fp);
+	writer->size = 0;
+}
+
+void write_string(writer_t *writer, char const *str)
+{
+	size_t const length = strlen(str);
+	if (writer->size + length > WRITER_BUFFER_SIZE) {
+		flush_writer(writer);
+		if (length > WRITER_BUFFER_SIZE) {
+			fwrite(str, 1, length, writer->fp);
+			return;
+		}
+	}
+	memcpy(writer->buffer + writer->size, str, length);
+	writer->size += length;
+}
+
+void write_csv_field(writer_t *writer, char const *str)
+{
+	// quote fields the tokenizer would otherwise split, doubling any quotes
+	if (!strpbrk(str, ",\"\r\n")) {
+		write_string(writer, str);
+		return;
+	}
+	char quoted[2*MAX_PERSON_NAME_LENGTH + 3];
+	size_t length = 0;
+	quoted[length++] = '"';
+	for (char const *c = str; *c && length + 3 < sizeof(quoted); ++c) {
+		if (*c == '"') {
+			quoted[length++] = '"';
+		}
+		quoted[length++] = *c;
+	}
+	quoted[length++] = '"';
+	quoted[length] = '\0';
+	write_string(writer, quoted);
+}
+
+void write_format(writer_t *writer, char const *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	size_t available = WRITER_BUFFER_SIZE - writer->size;
+	va_list retry_args;
+	va_copy(retry_args, args);
+	int length = vsnprintf(writer->buffer + writer->size, available, format, args);
+	if (length >= 0 && (size_t)length >= available) {
+		// did not fit, so try again at the start of an empty buffer
+		flush_writer(writer);
+		length = vsnprintf(writer->buffer, WRITER_BUFFER_SIZE, format, retry_args);
+		if (length >= WRITER_BUFFER_SIZE) {
+			fprintf(stderr, "formatted output is too long!\n");
+			exit(-1);
+		}
+	}
+	va_end(retry_args);
+	va_end(args);
+	if (length > 0) {
+		writer->size += length;
+	}
+}
+
+void close_writer(writer_t *writer)
+{
+	flush_writer(writer);
+	fclose(writer->fp);
+	free(writer);
+}
+
+/*
+	HTML reports.
+
+	Cells are coloured by class from one shared stylesheet rather than
+	each carrying its own style attribute.
+*/
+
+void write_html_header(writer_t *writer, char const *title)
+{
+	write_string(writer, "<!DOCTYPE html>\n\
+<html>\n\
+<head>\n\
+<style>\n\
+table, th, td {\n\
+border: 1px solid black;\n\
+border-collapse: collapse;\n\
+}\n\
+th, td {\n\
+padding: 5px;\n\
+}\n\
+table tr td {\n\
+width: 10px;\n\
+}\n\
+.n { white-space: nowrap; }\n\
+.h { background-color: grey; }\n\
+.b { background-color: lightblue; }\n\
+.e { background-color: cyan; }\n\
+.w { background-color: yellow; }\n\
+.c { background-color: red; }\n\
+.x { background-color: black; }\n\
+.f { background-color: green; }\n\
+.i { background-color: darkred; }\n\
+.o { background-color: orange; }\n\
+</style>\n\
+</head>\n\
+<body>\n\
+<h1>");
+	write_string(writer, title);
+	write_string(writer, "</h1>\n");
+}
+
+void write_html_week_headings(writer_t *writer, config_t const *config)
+{
+	for (int week_index = 0; week_index < config->week_count; ++week_index) {
+		write_string(writer, "<th colspan=\"7\">");
+		write_string(writer, config->calendar[7*week_index].date);
+		write_string(writer, "</th>\n");
+	}
+}
+
+void write_html_cell(writer_t *writer, char const *class_name, char const *contents)
+{
+	// the end tag is optional in HTML and most of these cells are empty
+	if (*class_name == '\0') {
+		write_string(writer, "<td>");
+	} else {
+		write_string(writer, "<td class=");
+		write_string(writer, class_name);
+		write_string(writer, ">");
+	}
+	write_string(writer, contents);
+}
+
+char const *get_calendar_class(calendar_day_t const *day)
+{
+	if (day->is_bank_holiday) {
+		return "b";
+	}
+	if (day->weekday_index >= 5) {
+		return "e";
+	}
+	return "";
+}
+
+void print_rota_html(
+	char const *filename,
+	config_t const *config,
+	rota_t const *rota,
+	score_t const *score)
+{
+	writer_t *const writer = open_writer(filename);
+
+	write_html_header(writer, "Rota Output");
+	write_string(writer, "<table>\n\
+<tr><th colspan=\"2\">Key</th></tr>\n\
+<tr><td class=\"n\">holiday</td><td class=\"h\"></td></tr>\n\
+<tr><td class=\"n\">bank holiday</td><td class=\"b\"></td></tr>\n\
+<tr><td class=\"n\">weekend</td><td class=\"e\"></td></tr>\n\
+<tr><td class=\"n\">ward week</td><td class=\"w\"></td></tr>\n\
+<tr><td class=\"n\">on call</td><td class=\"c\"></td></tr>\n\
+</table>\n\
+<br>\n\
+");
+
+	write_string(writer, "<table>\n<tr>\n<th>Name</th>\n");
+	write_html_week_headings(writer, config);
+	write_string(writer, "</tr>");
+	for (int person_index = 0; person_index < config->person_count; ++person_index) {
+		write_string(writer, "<tr><td class=\"n\">");
+		write_string(writer, config->people[person_index].name);
+		write_string(writer, "</td>\n");
+		for (int week_index = 0; week_index < config->week_count; ++week_index) {
+			week_t const *const week = &rota->weeks[week_index];
+			bool const is_ward_week = (week->shifts[SHIFT_WARD_WEEK] == person_index);
+			bool const mark_ward_week = is_disliked_ward_week(config, week_index, person_index);
+			for (int weekday_index = 0; weekday_index < 7; ++weekday_index) {
+				int const rota_day_index = 7*week_index + weekday_index;
+				int const person_on_call = (weekday_index < 5) ? week->shifts[weekday_index] : week->shifts[SHIFT_ON_CALL_WEEKEND];
+				bool const mark_on_call = is_disliked_on_call_day(config, rota_day_index, person_index);
+				char const *class_name = "";
+				char const *contents = "";
+				if (person_index == person_on_call) {
+					class_name = "c";
+					if (mark_on_call) {
+						contents = "x";
+					}
+				} else if (weekday_index < 5 && is_ward_week) {
+					class_name = "w";
+					if (mark_ward_week) {
+						contents = "x";
+					}
+				} else if (is_holiday_day(config, rota_day_index, person_index)) {
+					class_name = "h";
+				} else {
+					class_name = get_calendar_class(&config->calendar[rota_day_index]);
+				}
+				write_html_cell(writer, class_name, contents);
+			}
+			write_string(writer, "\n");
+		}
+		write_string(writer, "</tr>");
+	}
+	write_string(writer, "</table>\n");
+
+	write_string(writer, "<h1>Summary</h1>\n<table>\n");
+	write_string(writer, "<tr>\n\
+<th rowspan=\"2\">Name</th>\n\
+<th colspan=\"2\">Full Time</th>\n\
+<th colspan=\"3\">Input Bias</th>\n\
+<th colspan=\"3\">Rota Target</th>\n\
+<th colspan=\"3\">Rota Result</th>\n\
+<th colspan=\"3\">Output Bias</th>\n\
+</tr>\n\
+");
+	write_string(writer, "<tr>\n\
+<th>Input</th><th>Effective</th>\n\
+<th>On Call Days (Bank Hols)</th><th>On Call Weekends</th><th>Ward Weeks</th>\n\
+<th>On Call Days (Bank Hols)</th><th>On Call Weekends</th><th>Ward Weeks</th>\n\
+<th>On Call Days (Bank Hols)</th><th>On Call Weekends</th><th>Ward Weeks</th>\n\
+<th>On Call Days (Bank Hols)</th><th>On Call Weekends</th><th>Ward Weeks</th>\n\
+</tr>\n\
+");
+	for (int person_index = 0; person_index < config->person_count; ++person_index) {
+		person_config_t const *person_config = &config->people[person_index];
+		person_score_t const *person_score = &score->people[person_index];
+		write_string(writer, "<tr><td>");
+		write_string(writer, person_config->name);
+		write_string(writer, "</td>\n");
+		write_format(writer, "<td>%.3f</td><td>%.3f</td>", person_config->full_time_amount, person_config->effective_full_time_amount);
+		write_format(writer, "<td>%f (%f)</td><td>%f</td><td>%f</td>",
+			person_config->on_call_day_bias,
+			person_config->bank_holiday_bias,
+			person_config->on_call_weekend_bias,
+			person_config->ward_week_bias);
+		write_format(writer, "<td>%.1f (%.1f)</td><td>%.1f</td><td>%.1f</td>",
+			person_config->target_on_call_days,
+			person_config->target_on_call_bank_holidays,
+			person_config->target_on_call_weekends,
+			person_config->target_ward_weeks);
+		write_format(writer, "<td>%d (%d)</td><td>%d</td><td>%d</td>",
+			person_score->total_on_call_days,
+			person_score->total_on_call_bank_holidays,
+			person_score->total_on_call_weekends,
+			person_score->total_ward_weeks);
+		write_format(writer, "<td>%.1f (%.1f)</td><td>%.1f</td><td>%.1f</td>",
+			person_score->remainder_on_call_days,
+			person_score->remainder_on_call_bank_holidays,
+			person_score->remainder_on_call_weekends,
+			person_score->remainder_ward_weeks);
+		write_string(writer, "</tr>\n");
+	}
+	write_string(writer, "</table>\n");
+
+	write_string(writer, "</body>\n</html>\n");
+	close_writer(writer);
+
+	printf("written output to \"%s\"\n", filename);
+}
+
+void print_rota_csv(char const *filename, config_t const *config, rota_t const *rota)
+{
+	writer_t *const writer = open_writer(filename);
+
+	for (int week_index = 0; week_index < config->week_count; ++week_index) {
+		write_string(writer, "Date");
+		for (int weekday_index = 0; weekday_index < 7; ++weekday_index) {
+			write_string(writer, ",");
+			write_string(writer, config->calendar[7*week_index + weekday_index].date);
+		}
+		write_string(writer, "\n");
+
+		week_t const *const week = &rota->weeks[week_index];
+
+		write_string(writer, "On Call");
+		for (int weekday_index = 0; weekday_index < 7; ++weekday_index) {
+			int const person_on_call = week->shifts[(weekday_index < 5) ? weekday_index : SHIFT_ON_CALL_WEEKEND];
+			write_string(writer, ",");
+			write_csv_field(writer, config->people[person_on_call].name);
+		}
+		write_string(writer, "\n");
+
+		write_string(writer, "Ward");
+		char const *const person_on_ward = config->people[week->shifts[SHIFT_WARD_WEEK]].name;
+		for (int weekday_index = 0; weekday_index < 5; ++weekday_index) {
+			write_string(writer, ",");
+			write_csv_field(writer, person_on_ward);
+		}
+		write_string(writer, ",,\n");
+
+		write_string(writer, ",,,,,,,\n");
+	}
+
+	close_writer(writer);
+
+	printf("written output to \"%s\"\n", filename);
+}
+
+int pick_active_week(config_t const *config, rng_t *rng)
+{
+	return config->active_weeks[rota_rand(rng, config->active_week_count)];
+}
+
+void build_free_slots(config_t *config)
+{
+	// flag the active weeks, then list their free shifts
+	memset(config->is_active_week, 0, config->week_count*sizeof(bool));
+	config->free_slot_count = 0;
+	for (int i = 0; i < config->active_week_count; ++i) {
+		int const week_index = config->active_weeks[i];
+		config->is_active_week[week_index] = true;
+		for (int shift = 0; shift < SHIFT_COUNT; ++shift) {
+			int const slot = week_index*SHIFT_COUNT + shift;
+			if (config->fixed_shifts[slot] == -1) {
+				config->free_slots[config->free_slot_count++] = slot;
+			}
+		}
+	}
+}
+
+int pick_free_slot(config_t const *config, rng_t *rng)
+{
+	return config->free_slots[rota_rand(rng, config->free_slot_count)];
+}
+
+bool is_fixed_slot(config_t const *config, int week_index, int shift)
+{
+	return config->fixed_shifts[week_index*SHIFT_COUNT + shift] != -1;
+}
+
+/*
+	Eligible people.
+
+	Most people break a hard constraint in any given shift, through a
+	holiday, start or end date or invalid day, so reassignments are drawn
+	from the people who do not, and only occasionally from anyone so that
+	the search can still pass through broken rotas.
+*/
+
+#define UNRESTRICTED_MOVE_ODDS		16
+
+int pick_eligible_person(config_t const *config, points_t const *points, rng_t *rng, int week_index, int shift)
+{
+	int const slot = week_index*SHIFT_COUNT + shift;
+	int const eligible_count = points->eligible_counts[slot];
+	if (eligible_count == 0 || rota_rand(rng, UNRESTRICTED_MOVE_ODDS) == 0) {
+		return rota_rand(rng, config->person_count);
+	}
+	uint64_t const *const words = &points->eligible_people[slot*points->eligible_word_count];
+	int n = rota_rand(rng, eligible_count);
+	for (int word_index = 0;; ++word_index) {
+		int const count = count_bits(words[word_index]);
+		if (n < count) {
+			return 64*word_index + select_bit(words[word_index], n);
+		}
+		n -= count;
+	}
+}
+
+void mutate_random_reassign(
+	config_t const *config,
+	rng_t *rng,
+	delta_t *delta)
+{
+	int const slot = pick_free_slot(config, rng);
+	int const week = slot/SHIFT_COUNT;
+	int const shift = slot % SHIFT_COUNT;
+
+	// half the time put back whoever had this shift in a previous rota
+	int person = -1;
+	if (config->previous_shifts && rota_rand(rng, 2) == 0) {
+		person = config->previous_shifts[week*SHIFT_COUNT + shift];
+	}
+	if (person == -1) {
+		person = pick_eligible_person(config, delta->points, rng, week, shift);
+	}
+	delta_reassign(delta, week, shift, person);
+}
+
+void mutate_random_swap(
+	config_t const *config,
+	rng_t *rng,
+	delta_t *delta)
+{
+	int const slot_a = pick_free_slot(config, rng);
+	int const week_a = slot_a/SHIFT_COUNT;
+	int const shift_a = slot_a % SHIFT_COUNT;
+
+	int const week_b = pick_active_week(config, rng);
+	int shift_b = shift_a;
+	if (shift_a < 5) {
+		shift_b = rota_rand(rng, 5);
+	}
+	if (is_fixed_slot(config, week_b, shift_b)) {
+		return;
+	}
+
+	int const person_a = delta->rota->weeks[week_a].shifts[shift_a];
+	int const person_b = delta->rota->weeks[week_b].shifts[shift_b];
+	delta_reassign(delta, week_a, shift_a, person_b);
+	delta_reassign(delta, week_b, shift_b, person_a);
+}
+
+/*
+	Batched reassignment.
+
+	Pick one shift and a batch of people who could take it, count the hard
+	constraints each of them would break there, and reassign the shift to
+	the person that breaks the fewest.  The counts only depend on the
+	constraint masks and the neighbouring shifts, so each candidate is a
+	lane: with AVX2 the masks are gathered for 8 candidates at once, with a
+	scalar loop otherwise (SSE2 has no per-lane gathers or variable shifts).
+	Swaps are not batched, since each candidate pair changes the neighbours
+	the other shift is checked against.
+*/
+
+#define MAX_BATCH_SIZE			64
+#define MAX_SLOT_MASKS			8
+#define MAX_SLOT_NEIGHBOURS		6
+#define MAX_SLOT_FORCED			2
+
+typedef struct
+{
+	int mask_count;
+	int neighbour_count;
+	int forced_count;
+	uint64_t const *masks[MAX_SLOT_MASKS];
+	int neighbours[MAX_SLOT_NEIGHBOURS];
+	int forced[MAX_SLOT_FORCED];
+} slot_checks_t;
+
+void add_slot_mask(config_t const *config, slot_checks_t *checks, int rota_day_index, int mask)
+{
+	uint64_t const *const record = get_day_record(config, rota_day_index);
+	checks->masks[checks->mask_count++] = &record[1 + mask*config->day_record_word_count];
+}
+
+void add_slot_neighbour(slot_checks_t *checks, int person)
+{
+	if (person >= 0) {
+		checks->neighbours[checks->neighbour_count++] = person;
+	}
+}
+
+void add_slot_forced(config_t const *config, slot_checks_t *checks, int rota_day_index)
+{
+	int const person = get_day_forced_on_call_person(get_day_record(config, rota_day_index));
+	if (person >= 0) {
+		checks->forced[checks->forced_count++] = person;
+	}
+}
+
+void get_slot_checks(
+	config_t const *config,
+	rota_t const *rota,
+	int week_index,
+	int shift,
+	slot_checks_t *checks)
+{
+	// the hard constraints of score_rota that involve whoever is in this shift
+	week_t const *const week = &rota->weeks[week_index];
+	week_t const *const last_week = (week_index > 0) ? &rota->weeks[week_index - 1] : NULL;
+	week_t const *const next_week = (week_index + 1 < config->week_count) ? &rota->weeks[week_index + 1] : NULL;
+	int const first_day = 7*week_index;
+	memset(checks, 0, sizeof(slot_checks_t));
+	switch (shift) {
+		case SHIFT_WARD_WEEK:
+			for (int i = 0; i < 5; ++i) {
+				add_slot_mask(config, checks, first_day + i, DAY_MASK_HOLIDAY);
+			}
+			add_slot_mask(config, checks, first_day, DAY_MASK_INVALID_WARD_WEEK);
+			add_slot_mask(config, checks, first_day, DAY_MASK_NO_WARD_WEEKS);
+			for (int i = 0; i < 5; ++i) {
+				add_slot_neighbour(checks, week->shifts[i]);
+			}
+			add_slot_neighbour(checks, last_week ? last_week->shifts[SHIFT_ON_CALL_WEEKEND] : -1);
+			break;
+
+		case SHIFT_ON_CALL_WEEKEND:
+			add_slot_mask(config, checks, first_day + 5, DAY_MASK_HOLIDAY);
+			add_slot_mask(config, checks, first_day + 6, DAY_MASK_HOLIDAY);
+			add_slot_mask(config, checks, first_day + 5, DAY_MASK_INVALID_ON_CALL);
+			add_slot_mask(config, checks, first_day + 6, DAY_MASK_INVALID_ON_CALL);
+			add_slot_neighbour(checks, week->shifts[SHIFT_ON_CALL_FRI]);
+			add_slot_neighbour(checks, next_week ? next_week->shifts[SHIFT_ON_CALL_MON] : -1);
+			add_slot_neighbour(checks, next_week ? next_week->shifts[SHIFT_WARD_WEEK] : -1);
+			add_slot_forced(config, checks, first_day + 5);
+			add_slot_forced(config, checks, first_day + 6);
+			break;
+
+		default:
+			add_slot_mask(config, checks, first_day + shift, DAY_MASK_HOLIDAY);
+			add_slot_mask(config, checks, first_day + shift + 1, DAY_MASK_HOLIDAY);
+			add_slot_mask(config, checks, first_day + shift, DAY_MASK_INVALID_ON_CALL);
+			add_slot_neighbour(checks, week->shifts[SHIFT_WARD_WEEK]);
+			if (shift > 0) {
+				add_slot_neighbour(checks, week->shifts[shift - 1]);
+			} else {
+				add_slot_neighbour(checks, last_week ? last_week->shifts[SHIFT_ON_CALL_WEEKEND] : -1);
+			}
+			add_slot_neighbour(checks, week->shifts[(shift < 4) ? (shift + 1) : SHIFT_ON_CALL_WEEKEND]);
+			add_slot_forced(config, checks, first_day + shift);
+			break;
+	}
+}
+
+void count_slot_failures_scalar(
+	slot_checks_t const *checks,
+	int const *people,
+	int begin,
+	int end,
+	int *failure_counts)
+{
+	for (int i = begin; i < end; ++i) {
+		int const person = people[i];
+		int count = 0;
+		for (int j = 0; j < checks->mask_count; ++j) {
+			count += (int)((checks->masks[j][person/64] >> (person % 64)) & 1);
+		}
+		for (int j = 0; j < checks->neighbour_count; ++j) {
+			count += (checks->neighbours[j] == person);
+		}
+		for (int j = 0; j < checks->forced_count; ++j) {
+			count += (checks->forced[j] != person);
+		}
+		failure_counts[i] = count;
+	}
+}
+
+void count_slot_failures(
+	slot_checks_t const *checks,
+	int const *people,
+	int count,
+	int *failure_counts)
+{
+	int i = 0;
+#ifdef __AVX2__
+	// masks are read as 32-bit words, which is fine on little-endian x86
+	__m256i const one = _mm256_set1_epi32(1);
+	__m256i const bit_mask = _mm256_set1_epi32(31);
+	for (; i + 8 <= count; i += 8) {
+		__m256i const person = _mm256_loadu_si256((__m256i const *)&people[i]);
+		__m256i const word_index = _mm256_srli_epi32(person, 5);
+		__m256i const bit_index = _mm256_and_si256(person, bit_mask);
+		__m256i sum = _mm256_setzero_si256();
+		for (int j = 0; j < checks->mask_count; ++j) {
+			__m256i const words = _mm256_i32gather_epi32((int const *)checks->masks[j], word_index, 4);
+			sum = _mm256_add_epi32(sum, _mm256_and_si256(_mm256_srlv_epi32(words, bit_index), one));
+		}
+		for (int j = 0; j < checks->neighbour_count; ++j) {
+			sum = _mm256_sub_epi32(sum, _mm256_cmpeq_epi32(person, _mm256_set1_epi32(checks->neighbours[j])));
+		}
+		for (int j = 0; j < checks->forced_count; ++j) {
+			sum = _mm256_add_epi32(sum, _mm256_andnot_si256(_mm256_cmpeq_epi32(person, _mm256_set1_epi32(checks->forced[j])), one));
+		}
+		_mm256_storeu_si256((__m256i *)&failure_counts[i], sum);
+	}
+#endif
+	count_slot_failures_scalar(checks, people, i, count, failure_counts);
+}
+
+void mutate_batched_reassign(
+	config_t const *config,
+	rng_t *rng,
+	delta_t *delta,
+	int batch_size)
+{
+	int const slot = pick_free_slot(config, rng);
+	int const week = slot/SHIFT_COUNT;
+	int const shift = slot % SHIFT_COUNT;
+
+	int people[MAX_BATCH_SIZE];
+	int failure_counts[MAX_BATCH_SIZE];
+	for (int i = 0; i < batch_size; ++i) {
+		people[i] = pick_eligible_person(config, delta->points, rng, week, shift);
+	}
+	slot_checks_t checks;
+	get_slot_checks(config, delta->rota, week, shift, &checks);
+	count_slot_failures(&checks, people, batch_size, failure_counts);
+
+	int best = 0;
+	for (int i = 1; i < batch_size; ++i) {
+		if (failure_counts[i] < failure_counts[best]) {
+			best = i;
+		}
+	}
+	delta_reassign(delta, week, shift, people[best]);
+}
+
+/*
+	Repair moves.
+
+	While the rota breaks hard constraints, some moves go straight to a
+	week with failures instead of a random one.  A shift that breaks a
+	constraint by itself is given to an eligible person.  A shift that
+	clashes with another (on call the day after an on call, or on call
+	during a ward week) is either given to an eligible person or swapped
+	with a neighbouring on call day, or with the same shift in another week.
+*/
+
+#define DEFAULT_REPAIR_RATE		.25f
+
+bool mutate_repair(config_t const *config, rng_t *rng, delta_t *delta)
+{
+	// pick any active week with failures
+	if (delta->failing_week_count == 0) {
+		return false;
+	}
+	int const week_index = delta->failing_weeks[rota_rand(rng, delta->failing_week_count)];
+	rota_t const *const rota = delta->rota;
+	week_t const *const week = &rota->weeks[week_index];
+
+	// shifts that break a constraint by themselves
+	int shifts[SHIFT_COUNT + 1];
+	int shift_count = 0;
+	for (int shift = 0; shift < SHIFT_COUNT; ++shift) {
+		if (!is_fixed_slot(config, week_index, shift) && get_slot_penalty(config, delta->points, week_index, shift, week->shifts[shift])->failure_count != 0) {
+			shifts[shift_count++] = shift;
+		}
+	}
+	if (shift_count > 0) {
+		int const shift = shifts[rota_rand(rng, shift_count)];
+		delta_reassign(delta, week_index, shift, pick_eligible_person(config, delta->points, rng, week_index, shift));
+		return true;
+	}
+
+	// otherwise shifts that clash, mirroring the checks in score_week_local
+	int const person_on_ward = week->shifts[SHIFT_WARD_WEEK];
+	int const person_on_call_last_weekend = (week_index > 0) ? rota->weeks[week_index - 1].shifts[SHIFT_ON_CALL_WEEKEND] : -1;
+	int person_on_call_yesterday = person_on_call_last_weekend;
+	for (int shift = 0; shift <= SHIFT_ON_CALL_WEEKEND; ++shift) {
+		int const person_on_call = week->shifts[shift];
+		if ((person_on_call == person_on_call_yesterday || (shift < 5 && person_on_call == person_on_ward)) && !is_fixed_slot(config, week_index, shift)) {
+			shifts[shift_count++] = shift;
+		}
+		person_on_call_yesterday = person_on_call;
+	}
+	if (person_on_ward == person_on_call_last_weekend && !is_fixed_slot(config, week_index, SHIFT_WARD_WEEK)) {
+		shifts[shift_count++] = SHIFT_WARD_WEEK;
+	}
+	if (shift_count == 0) {
+		return false;
+	}
+	int const shift = shifts[rota_rand(rng, shift_count)];
+	int other_week_index = week_index;
+	int other_shift = shift;
+	if (shift < 5) {
+		other_shift = (shift == 0) ? 1 : (shift == 4) ? 3 : (shift + 2*rota_rand(rng, 2) - 1);
+	} else {
+		other_week_index = pick_active_week(config, rng);
+	}
+	if (rota_rand(rng, 2) == 0 || (other_week_index == week_index && other_shift == shift) || is_fixed_slot(config, other_week_index, other_shift)) {
+		delta_reassign(delta, week_index, shift, pick_eligible_person(config, delta->points, rng, week_index, shift));
+	} else {
+		int const person = week->shifts[shift];
+		int const other_person = rota->weeks[other_week_index].shifts[other_shift];
+		delta_reassign(delta, week_index, shift, other_person);
+		delta_reassign(delta, other_week_index, other_shift, person);
+	}
+	return true;
+}
+
+/*
+	Compound moves.
+
+	Single shift moves get stuck where any one change breaks something, such
+	as a ward week that takes its weekend on call with it, or two people whose
+	on calls interleave.  These moves change a block of shifts at once: all of
+	two weeks, everything two people do over a few weeks, a ward week with its
+	weekend, or the chain of clashing shifts held by two people (a Kempe chain,
+	as used for timetabling), which swaps cleanly without new clashes between
+	them.
+*/
+
+#define COMPOUND_MOVE_ODDS			8
+#define MAX_PERSON_SWAP_WEEKS		4
+#define MAX_CHAIN_LENGTH			32
+#define MAX_CLASHING_SLOTS			7
+
+bool is_active_week(config_t const *config, int week_index)
+{
+	return week_index >= 0 && week_index < config->week_count && config->is_active_week[week_index];
+}
+
+int add_swapped_slot(delta_t const *delta, int slot, int person_a, int person_b, int *slots, int *people, int count)
+{
+	if (delta->config->fixed_shifts[slot] != -1) {
+		return count;
+	}
+	int const person = delta->rota->weeks[slot/SHIFT_COUNT].shifts[slot % SHIFT_COUNT];
+	if (person == person_a || person == person_b) {
+		slots[count] = slot;
+		people[count++] = (person == person_a) ? person_b : person_a;
+	}
+	return count;
+}
+
+void swap_weeks(config_t const *config, delta_t *delta, int week_a, int week_b, int first_shift, int last_shift)
+{
+	if (week_a == week_b) {
+		return;
+	}
+	week_t const *const weeks = delta->rota->weeks;
+	int slots[2*SHIFT_COUNT];
+	int people[2*SHIFT_COUNT];
+	int count = 0;
+	for (int shift = first_shift; shift <= last_shift; ++shift) {
+		if (!is_fixed_slot(config, week_a, shift) && !is_fixed_slot(config, week_b, shift)) {
+			slots[count] = week_a*SHIFT_COUNT + shift;
+			people[count++] = weeks[week_b].shifts[shift];
+			slots[count] = week_b*SHIFT_COUNT + shift;
+			people[count++] = weeks[week_a].shifts[shift];
+		}
+	}
+	delta_reassign_slots(delta, slots, people, count);
+}
+
+void mutate_week_swap(config_t const *config, rng_t *rng, delta_t *delta)
+{
+	int const week_a = pick_active_week(config, rng);
+	int const week_b = pick_active_week(config, rng);
+	swap_weeks(config, delta, week_a, week_b, 0, SHIFT_COUNT - 1);
+}
+
+void mutate_person_swap(config_t const *config, rng_t *rng, delta_t *delta)
+{
+	// swap with someone who could take one of the shifts in the window
+	int const first = rota_rand(rng, config->active_week_count);
+	int const week_count = 1 + rota_rand(rng, MAX_PERSON_SWAP_WEEKS);
+	int const last = MIN(first + week_count, config->active_week_count);
+	int const week_index = config->active_weeks[first];
+	int const shift = rota_rand(rng, SHIFT_COUNT);
+	int const person_a = delta->rota->weeks[week_index].shifts[shift];
+	int const person_b = pick_eligible_person(config, delta->points, rng, week_index, shift);
+	if (person_a == person_b) {
+		return;
+	}
+	int slots[MAX_PERSON_SWAP_WEEKS*SHIFT_COUNT];
+	int people[MAX_PERSON_SWAP_WEEKS*SHIFT_COUNT];
+	int count = 0;
+	for (int i = first; i < last; ++i) {
+		for (int j = 0; j < SHIFT_COUNT; ++j) {
+			count = add_swapped_slot(delta, config->active_weeks[i]*SHIFT_COUNT + j, person_a, person_b, slots, people, count);
+		}
+	}
+	delta_reassign_slots(delta, slots, people, count);
+}
+
+void mutate_ward_weekend_swap(config_t const *config, rng_t *rng, delta_t *delta)
+{
+	int const week_a = pick_active_week(config, rng);
+	int const week_b = pick_active_week(config, rng);
+	swap_weeks(config, delta, week_a, week_b, SHIFT_ON_CALL_WEEKEND, SHIFT_WARD_WEEK);
+}
+
+int get_clashing_slots(config_t const *config, int slot, int *slots)
+{
+	// slots that break a constraint if one person has both, as in score_week_local
+	int const shift = slot % SHIFT_COUNT;
+	int candidates[MAX_CLASHING_SLOTS];
+	int candidate_count = 0;
+	if (shift < SHIFT_ON_CALL_WEEKEND) {
+		candidates[candidate_count++] = slot - shift + SHIFT_WARD_WEEK;
+		candidates[candidate_count++] = slot + 1;
+		candidates[candidate_count++] = (shift > 0) ? (slot - 1) : (slot - SHIFT_COUNT + SHIFT_ON_CALL_WEEKEND);
+	} else if (shift == SHIFT_ON_CALL_WEEKEND) {
+		candidates[candidate_count++] = slot - 1;
+		candidates[candidate_count++] = slot - shift + SHIFT_COUNT + SHIFT_ON_CALL_MON;
+		candidates[candidate_count++] = slot - shift + SHIFT_COUNT + SHIFT_WARD_WEEK;
+	} else {
+		for (int i = 0; i < SHIFT_ON_CALL_WEEKEND; ++i) {
+			candidates[candidate_count++] = slot - shift + i;
+		}
+		candidates[candidate_count++] = slot - shift - SHIFT_COUNT + SHIFT_ON_CALL_WEEKEND;
+	}
+
+	int slot_count = 0;
+	for (int i = 0; i < candidate_count; ++i) {
+		int const candidate = candidates[i];
+		if (0 <= candidate && candidate < config->week_count*SHIFT_COUNT) {
+			slots[slot_count++] = candidate;
+		}
+	}
+	return slot_count;
+}
+
+void mutate_chain_swap(config_t const *config, rng_t *rng, delta_t *delta)
+{
+	int const start_slot = pick_free_slot(config, rng);
+	int const week_index = start_slot/SHIFT_COUNT;
+	int const shift = start_slot % SHIFT_COUNT;
+	week_t const *const weeks = delta->rota->weeks;
+	int const person_a = weeks[week_index].shifts[shift];
+	int const person_b = pick_eligible_person(config, delta->points, rng, week_index, shift);
+	if (person_a == person_b) {
+		return;
+	}
+
+	// grow the chain through clashing slots held by either person
+	int chain[MAX_CHAIN_LENGTH];
+	int chain_length = 0;
+	chain[chain_length++] = start_slot;
+	for (int i = 0; i < chain_length; ++i) {
+		int slots[MAX_CLASHING_SLOTS];
+		int const slot_count = get_clashing_slots(config, chain[i], slots);
+		for (int j = 0; j < slot_count && chain_length < MAX_CHAIN_LENGTH; ++j) {
+			// only free slots in weeks that mutations may touch
+			int const slot = slots[j];
+			int const slot_week_index = slot/SHIFT_COUNT;
+			int const person = weeks[slot_week_index].shifts[slot % SHIFT_COUNT];
+			if ((person != person_a && person != person_b)
+				|| config->fixed_shifts[slot] != -1
+				|| (slot_week_index != week_index && !is_active_week(config, slot_week_index))) {
+				continue;
+			}
+			bool is_in_chain = false;
+			for (int k = 0; k < chain_length; ++k) {
+				if (chain[k] == slot) {
+					is_in_chain = true;
+					break;
+				}
+			}
+			if (!is_in_chain) {
+				chain[chain_length++] = slot;
+			}
+		}
+	}
+
+	// swap the people on every slot of the chain
+	int people[MAX_CHAIN_LENGTH];
+	int count = 0;
+	for (int i = 0; i < chain_length; ++i) {
+		count = add_swapped_slot(delta, chain[i], person_a, person_b, chain, people, count);
+	}
+	delta_reassign_slots(delta, chain, people, count);
+}
+
+/*
+	CSV tokenizer.
+
+	Input files are mapped into memory and walked in place one field at a
+	time, so rows can be any length and nothing is copied for the many
+	empty cells of an availability export.  Fields may be quoted, with ""
+	for a literal quote; only quoted fields that contain one are unescaped,
+	into a scratch buffer that is reused by the next such field.
+*/
+
+#define MAX_FIELD_LENGTH		256
+
+typedef struct
+{
+	char const *start;
+	int length;
+} csv_field_t;
+
+typedef struct
+{
+	char const *filename;
+	char const *data;
+	size_t size;
+	char const *p;
+	char const *end;
+	bool is_row_end;
+	char *scratch;
+	int scratch_capacity;
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#endif
+} csv_t;
+
+void csv_open(csv_t *csv, char const *filename)
+{
+	memset(csv, 0, sizeof(csv_t));
+	csv->filename = filename;
+	csv->is_row_end = true;
+#ifdef _WIN32
+	csv->file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	LARGE_INTEGER size;
+	if (csv->file == INVALID_HANDLE_VALUE || !GetFileSizeEx(csv->file, &size)) {
+		fprintf(stderr, "failed to open file \"%s\" for reading!\n", filename);
+		exit(-1);
+	}
+	csv->size = (size_t)size.QuadPart;
+	if (csv->size != 0) {
+		csv->mapping = CreateFileMappingA(csv->file, NULL, PAGE_READONLY, 0, 0, NULL);
+		csv->data = csv->mapping ? (char const *)MapViewOfFile(csv->mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+		if (!csv->data) {
+			fprintf(stderr, "failed to map file \"%s\"!\n", filename);
+			exit(-1);
+		}
+	}
+#else
+	int const fd = open(filename, O_RDONLY);
+	struct stat st;
+	if (fd == -1 || fstat(fd, &st) != 0) {
+		fprintf(stderr, "failed to open file \"%s\" for reading!\n", filename);
+		exit(-1);
+	}
+	csv->size = (size_t)st.st_size;
+	if (csv->size != 0) {
+		void *const data = mmap(NULL, csv->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED) {
+			fprintf(stderr, "failed to map file \"%s\"!\n", filename);
+			exit(-1);
+		}
+		csv->data = (char const *)data;
+	}
+	close(fd);
+#endif
+	csv->p = csv->data;
+	csv->end = csv->data + csv->size;
+}
+
+void csv_close(csv_t *csv)
+{
+#ifdef _WIN32
+	if (csv->data) {
+		UnmapViewOfFile(csv->data);
+		CloseHandle(csv->mapping);
+	}
+	CloseHandle(csv->file);
+#else
+	if (csv->data) {
+		munmap((void *)csv->data, csv->size);
+	}
+#endif
+	free(csv->scratch);
+}
+
+void csv_end_field(csv_t *csv)
+{
+	// step over the delimiter, with either line ending
+	char const *p = csv->p;
+	while (p != csv->end && *p != ',' && *p != '\r' && *p != '\n') {
+		++p;
+	}
+	if (p == csv->end) {
+		csv->is_row_end = true;
+	} else if (*p == ',') {
+		++p;
+	} else {
+		if (*p == '\r' && p + 1 != csv->end && p[1] == '\n') {
+			++p;
+		}
+		++p;
+		csv->is_row_end = true;
+	}
+	csv->p = p;
+}
+
+bool csv_next_field(csv_t *csv, csv_field_t *field)
+{
+	if (csv->is_row_end) {
+		return false;
+	}
+	char const *p = csv->p;
+	char const *const end = csv->end;
+	if (p == end || *p != '"') {
+		field->start = p;
+		while (p != end && *p != ',' && *p != '\r' && *p != '\n') {
+			++p;
+		}
+		field->length = (int)(p - field->start);
+		csv->p = p;
+		csv_end_field(csv);
+		return true;
+	}
+
+	// quoted, which is only copied when there are quotes to unescape
+	char const *const start = ++p;
+	int quote_count = 0;
+	for (;;) {
+		if (p == end) {
+			fprintf(stderr, "unterminated quoted field in \"%s\"!\n", csv->filename);
+			exit(-1);
+		}
+		if (*p == '"') {
+			if (p + 1 == end || p[1] != '"') {
+				break;
+			}
+			++quote_count;
+			++p;
+		}
+		++p;
+	}
+	int const length = (int)(p - start);
+	if (quote_count == 0) {
+		field->start = start;
+		field->length = length;
+	} else {
+		if (csv->scratch_capacity < length) {
+			csv->scratch_capacity = length;
+			csv->scratch = (char *)realloc(csv->scratch, length);
+		}
+		int n = 0;
+		for (char const *q = start; q != p; ++q) {
+			csv->scratch[n++] = *q;
+			if (*q == '"') {
+				++q;
+			}
+		}
+		field->start = csv->scratch;
+		field->length = n;
+	}
+	csv->p = p + 1;
+	csv_end_field(csv);
+	return true;
+}
+
+bool csv_next_row(csv_t *csv)
+{
+	// skip whatever is left of the current row
+	csv_field_t field;
+	while (csv_next_field(csv, &field)) {
+	}
+	if (csv->p == csv->end) {
+		return false;
+	}
+	csv->is_row_end = false;
+	return true;
+}
+
+bool is_field(csv_field_t const *field, char const *str)
+{
+	return strncmp(field->start, str, field->length) == 0 && str[field->length] == '\0';
+}
+
+char const *copy_field(csv_field_t const *field, char *buf, int size)
+{
+	if (field->length >= size) {
+		fprintf(stderr, "field \"%.32s...\" is too long!\n", field->start);
+		exit(-1);
+	}
+	memcpy(buf, field->start, field->length);
+	buf[field->length] = '\0';
+	return buf;
+}
+
+/*
+	Name lookup.
+
+	Category and points names are found with a small open addressing hash
+	table rather than comparing against every name in turn.
+*/
+
+#define NAME_HASH_BITS			6
+#define NAME_HASH_SIZE			(1 << NAME_HASH_BITS)
+
+typedef struct
+{
+	char const *const *names;
+	int8_t slots[NAME_HASH_SIZE];
+} name_hash_t;
+
+uint32_t hash_name(char const *str, int length)
+{
+	// FNV-1a
+	uint32_t hash = 2166136261U;
+	for (int i = 0; i < length; ++i) {
+		hash = (hash ^ (uint8_t)str[i])*16777619U;
+	}
+	return hash;
+}
+
+void init_name_hash(name_hash_t *hash, char const *const *names, int count)
+{
+	hash->names = names;
+	memset(hash->slots, -1, sizeof(hash->slots));
+	for (int i = 0; i < count; ++i) {
+		uint32_t slot = hash_name(names[i], (int)strlen(names[i]));
+		while (hash->slots[slot & (NAME_HASH_SIZE - 1)] != -1) {
+			++slot;
+		}
+		hash->slots[slot & (NAME_HASH_SIZE - 1)] = (int8_t)i;
+	}
+}
+
+int find_name(name_hash_t const *hash, csv_field_t const *field)
+{
+	uint32_t slot = hash_name(field->start, field->length);
+	for (;;) {
+		int const index = hash->slots[slot & (NAME_HASH_SIZE - 1)];
+		if (index == -1 || is_field(field, hash->names[index])) {
+			return index;
+		}
+		++slot;
+	}
+}
+
+void parse_date_parts(char const *str, int *day, int *month, int *year)
+{
+	if (sscanf(str, "%d/%d/%d", day, month, year) != 3) {
+		fprintf(stderr, "failed to parse date \"%s\"!\n", str);
+		exit(-1);
+	}
+}
+
+int get_days_in_month(int month, int year)
+{
+	static int const s_days_in_month[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+	bool const is_leap_year = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+	return (month == 2 && is_leap_year) ? 29 : s_days_in_month[month - 1];
+}
+
+void build_calendar(config_t *config)
+{
+	// one localtime for the first day, then step through the calendar
+	int const day_count = 7*config->week_count;
+	config->calendar = (calendar_day_t *)malloc(day_count*sizeof(calendar_day_t));
+	tm_t const *const tm = localtime(&config->first_day);
+	int day = tm->tm_mday;
+	int month = tm->tm_mon + 1;
+	int year = tm->tm_year + EPOCH_YEAR;
+	for (int rota_day_index = 0; rota_day_index < day_count; ++rota_day_index) {
+		calendar_day_t *const calendar_day = &config->calendar[rota_day_index];
+		snprintf(calendar_day->date, sizeof(calendar_day->date), "%d/%d/%d", day, month, year);
+		calendar_day->weekday_index = rota_day_index % 7;
+		calendar_day->is_bank_holiday = is_bank_holiday(config, rota_day_index);
+		if (++day > get_days_in_month(month, year)) {
+			day = 1;
+			if (++month > 12) {
+				month = 1;
+				++year;
+			}
+		}
+	}
+}
+
+int get_day_number(int day, int month, int year)
+{
+	// days since 1/3/0000 in the gregorian calendar, without going through mktime
+	year -= (month <= 2) ? 1 : 0;
+	int const era = year/400;
+	int const year_of_era = year - 400*era;
+	int const day_of_year = (153*(month + ((month > 2) ? -3 : 9)) + 2)/5 + day - 1;
+	return 146097*era + 365*year_of_era + year_of_era/4 - year_of_era/100 + day_of_year;
+}
+
+time_t parse_date(char const *str)
+{
+	int day,month,year;
+	parse_date_parts(str, &day, &month, &year);
+
+	tm_t tm;
+	memset(&tm, 0, sizeof(tm_t));
+	tm.tm_year = year - EPOCH_YEAR;
+	tm.tm_mday = day;
+	tm.tm_mon = month - 1;
+	tm.tm_hour = 12;
+	tm.tm_isdst = 1;
+
+	time_t const t = mktime(&tm);
+	if (t == INVALID_TIME) {
+		fprintf(stderr, "failed to convert date \"%s\"!\n", str);
+		exit(-1);
+	}
+	return t;
+}
+
+int find_or_add_person(config_t *config, char const *name)
+{
+	if (*name == '\0') {
+		fprintf(stderr, "name must not be empty!\n");
+		exit(-1);
+	}
+
+	int person = 0;
+	for (;;) {
+		if (person == config->person_count) {
+			if (person == config->person_capacity) {
+				config->person_capacity = (person == 0) ? 16 : 2*person;
+				config->people = (person_config_t *)realloc(config->people, config->person_capacity*sizeof(person_config_t));
+			}
+			grow_person_bits(&config->holiday_day_bits, person + 1);
+			grow_person_bits(&config->invalid_on_call_day_bits, person + 1);
+			grow_person_bits(&config->invalid_ward_week_bits, person + 1);
+			grow_person_bits(&config->disliked_on_call_day_bits, person + 1);
+			grow_person_bits(&config->disliked_ward_week_bits, person + 1);
+			person_config_t *const info = &config->people[person];
+			memset(info, 0, sizeof(person_config_t));
+			strcpy(info->name, name);
+			info->full_time_amount = 1.f;
+			info->first_day = 0;
+			info->last_day = config->week_count*7 - 1;
+			info->effective_full_time_amount = 1.f;
+			++config->person_count;
+			break;
+		}
+		if (strcmp(config->people[person].name, name) == 0) {
+			break;
+		}
+		++person;
+	}
+	return person;
+}
+
+enum
+{
+	CATEGORY_HOLIDAY,
+	CATEGORY_CANNOT_ON_CALL_DAY,
+	CATEGORY_CANNOT_ON_CALL_DAY_ALWAYS,
+	CATEGORY_CANNOT_WARD_WEEK,
+	CATEGORY_DISLIKE_ON_CALL_DAY,
+	CATEGORY_DISLIKE_ON_CALL_DAY_ALWAYS,
+	CATEGORY_DISLIKE_WARD_WEEK,
 	CATEGORY_PART_TIME,
 	CATEGORY_START_DATE,
 	CATEGORY_END_DATE,
@@ -867,638 +3146,3253 @@ enum
 	CATEGORY_COUNT
 };
 
-#define NAME_HOLIDAY				"holiday"
-#define NAME_CANNOT_ON_CALL_DAY		"cannot be on call"
-#define NAME_CANNOT_WARD_WEEK		"cannot be on ward"
-#define NAME_DISLIKE_ON_CALL_DAY	"prefer not on call"
-#define NAME_DISLIKE_WARD_WEEK		"prefer not on ward"
-#define NAME_PART_TIME				"part time"
-#define NAME_START_DATE				"start date"
-#define NAME_END_DATE				"end date"
-#define NAME_BANK_HOLIDAY			"bank holiday"
-#define NAME_BANK_HOLIDAY_BIAS		"bank holiday bias"
-#define NAME_WARD_WEEK_BIAS			"ward week bias"
-#define NAME_ON_CALL_DAY_BIAS		"on call day bias"
-#define NAME_ON_CALL_WEEKEND_BIAS	"on call weekend bias"
-#define NAME_NO_WARD_WEEKS			"no ward weeks"
-#define NAME_FORCE_ON_CALL_DAY		"must be on call"
+#define NAME_HOLIDAY				"holiday"
+#define NAME_CANNOT_ON_CALL_DAY		"cannot be on call"
+#define NAME_CANNOT_WARD_WEEK		"cannot be on ward"
+#define NAME_DISLIKE_ON_CALL_DAY	"prefer not on call"
+#define NAME_DISLIKE_WARD_WEEK		"prefer not on ward"
+#define NAME_PART_TIME				"part time"
+#define NAME_START_DATE				"start date"
+#define NAME_END_DATE				"end date"
+#define NAME_BANK_HOLIDAY			"bank holiday"
+#define NAME_BANK_HOLIDAY_BIAS		"bank holiday bias"
+#define NAME_WARD_WEEK_BIAS			"ward week bias"
+#define NAME_ON_CALL_DAY_BIAS		"on call day bias"
+#define NAME_ON_CALL_WEEKEND_BIAS	"on call weekend bias"
+#define NAME_NO_WARD_WEEKS			"no ward weeks"
+#define NAME_FORCE_ON_CALL_DAY		"must be on call"
+
+static char const *const g_category_names[CATEGORY_COUNT] =
+{
+	NAME_HOLIDAY,
+	NAME_CANNOT_ON_CALL_DAY,
+	"always " NAME_CANNOT_ON_CALL_DAY,
+	NAME_CANNOT_WARD_WEEK,
+	NAME_DISLIKE_ON_CALL_DAY,
+	"always " NAME_DISLIKE_ON_CALL_DAY,
+	NAME_DISLIKE_WARD_WEEK,
+	NAME_PART_TIME,
+	NAME_START_DATE,
+	NAME_END_DATE,
+	NAME_BANK_HOLIDAY,
+	NAME_BANK_HOLIDAY_BIAS,
+	NAME_WARD_WEEK_BIAS,
+	NAME_ON_CALL_DAY_BIAS,
+	NAME_ON_CALL_WEEKEND_BIAS,
+	NAME_NO_WARD_WEEKS,
+	NAME_FORCE_ON_CALL_DAY
+};
+
+int match_category_by_tag(name_hash_t const *category_hash, csv_field_t const *tag)
+{
+	int const category = find_name(category_hash, tag);
+	if (category == -1) {
+		fprintf(stderr, "unknown category \"%.*s\"!\n", tag->length, tag->start);
+		exit(-1);
+	}
+	return category;
+}
+
+#define FIRST_DAY_COLUMN		2
+
+void read_config(char const *filename, config_t *config)
+{
+	memset(config, 0, sizeof(config_t));
+
+	csv_t csv;
+	csv_open(&csv, filename);
+	name_hash_t category_hash;
+	init_name_hash(&category_hash, g_category_names, CATEGORY_COUNT);
+
+	// check first row headers and get date range
+	if (!csv_next_row(&csv)) {
+		fprintf(stderr, "failed to read first line of input file!\n");
+		exit(-1);
+	}
+	int day_count = 0;
+	int first_day_number = 0;
+	csv_field_t field;
+	char value[MAX_FIELD_LENGTH];
+	for (int col = 0;; ++col) {
+		if (!csv_next_field(&csv, &field) || field.length == 0) {
+			day_count = col - FIRST_DAY_COLUMN;
+			if ((day_count % 7) != 0) {
+				fprintf(stderr, "rota must be a whole number of weeks!\n");
+				exit(-1);
+			}
+			config->week_count = day_count/7;
+			if (config->week_count == 0) {
+				fprintf(stderr, "rota must be at least one week!\n");
+				exit(-1);
+			}
+			config->bank_holiday_bits = (uint *)calloc(DIV_ROUND_UP(day_count, 32), sizeof(uint));
+			config->forced_on_call_people = (int *)malloc(day_count*sizeof(int));
+			for (int i = 0; i < day_count; ++i) {
+				config->forced_on_call_people[i] = -1;
+			}
+			init_person_bits(&config->holiday_day_bits, day_count + 1);
+			init_person_bits(&config->invalid_on_call_day_bits, day_count);
+			init_person_bits(&config->invalid_ward_week_bits, config->week_count);
+			init_person_bits(&config->disliked_on_call_day_bits, day_count);
+			init_person_bits(&config->disliked_ward_week_bits, config->week_count);
+			break;
+		}
+		if (col == FIRST_DAY_COLUMN) {
+			config->first_day = parse_date(copy_field(&field, value, sizeof(value)));
+
+			// check first day is the first day of the week
+			tm_t *t = localtime(&config->first_day);
+			if (!t || t->tm_wday != 1) {
+				fprintf(stderr, "first rota day must be a Monday!\n");
+				exit(-1);
+			}
+			first_day_number = get_day_number(t->tm_mday, t->tm_mon + 1, t->tm_year + EPOCH_YEAR);
+		}
+		if (col > FIRST_DAY_COLUMN) {
+			int day, month, year;
+			parse_date_parts(copy_field(&field, value, sizeof(value)), &day, &month, &year);
+			if (get_day_number(day, month, year) != first_day_number + (col - FIRST_DAY_COLUMN)) {
+				fprintf(stderr, "column %d has unexpected day!\n", col);
+				exit(-1);
+			}
+		}
+	}
+	config->total_on_call_days_and_bias = 5*config->week_count;
+	config->total_on_call_weekends_and_bias = config->week_count;
+	config->total_ward_weeks_and_bias = config->week_count;
+
+	// handle each row
+	while (csv_next_row(&csv)) {
+		int person = -1;
+		int category = -1;
+		for (int col = 0; col < FIRST_DAY_COLUMN + day_count && csv_next_field(&csv, &field); ++col) {
+			if (col == 0) {
+				// skip rows with no person
+				if (field.length != 0) {
+					char name[MAX_PERSON_NAME_LENGTH];
+					person = find_or_add_person(config, copy_field(&field, name, sizeof(name)));
+				}
+			} else if (col == 1) {
+				// only allow bank holidays with no person
+				if (field.length == 0) {
+					if (person == -1) {
+						break;
+					}
+					fprintf(stderr, "expected category!\n");
+					exit(-1);
+				}
+				category = match_category_by_tag(&category_hash, &field);
+				if (person == -1 && category != CATEGORY_BANK_HOLIDAY) {
+					break;
+				}
+			} else if (field.length != 0) {
+				int const rota_day_index = col - FIRST_DAY_COLUMN;
+				int const weekday_index = rota_day_index % 7;
+				float amount = 0.f;
+				switch (category) {
+					case CATEGORY_HOLIDAY:
+						set_holiday_day(config, rota_day_index, person);
+						break;
+
+					case CATEGORY_CANNOT_ON_CALL_DAY:
+						set_invalid_on_call_day(config, rota_day_index, person);
+						break;
+
+					case CATEGORY_CANNOT_ON_CALL_DAY_ALWAYS:
+						for (int week_index = 0; week_index < config->week_count; ++week_index) {
+							int const day_index_always = 7*week_index + weekday_index;
+							set_invalid_on_call_day(config, day_index_always, person);
+						}
+						break;
+
+					case CATEGORY_DISLIKE_ON_CALL_DAY:
+						set_disliked_on_call_day(config, rota_day_index, person);
+						break;
+
+					case CATEGORY_DISLIKE_ON_CALL_DAY_ALWAYS:
+						for (int week_index = 0; week_index < config->week_count; ++week_index) {
+							int const day_index_always = 7*week_index + weekday_index;
+							set_disliked_on_call_day(config, day_index_always, person);
+						}
+						break;
+
+					case CATEGORY_CANNOT_WARD_WEEK:
+						if (weekday_index < 5) {
+							set_invalid_ward_week(config, rota_day_index/7, person);
+						} else {
+							fprintf(stderr, "found cannot ward week on a weekend day, ignoring it!\n");
+						}
+						break;
+
+					case CATEGORY_DISLIKE_WARD_WEEK:
+						if (weekday_index < 5) {
+							set_disliked_ward_week(config, rota_day_index/7, person);
+						} else {
+							fprintf(stderr, "found dislike of ward week on a weekend day, ignoring it!\n");
+						}
+						break;
+
+					case CATEGORY_PART_TIME:
+						copy_field(&field, value, sizeof(value));
+						if (sscanf(value, "%f", &amount) != 1) {
+							fprintf(stderr, "part time amount \"%s\" is not valid!\n", value);
+							exit(-1);
+						}
+						if (amount < 0.f || 1.f < amount) {
+							fprintf(stderr, "part time amount %f is not valid!\n", amount);
+							exit(-1);
+						}
+						config->people[person].full_time_amount = amount;
+						break;
+
+					case CATEGORY_START_DATE:
+						if (config->people[person].first_day != 0) {
+							fprintf(stderr, "cannot set multiple start dates per person!\n");
+							exit(-1);
+						}
+						config->people[person].first_day = rota_day_index;
+						break;
+
+					case CATEGORY_END_DATE:
+						if (config->people[person].last_day != 7*config->week_count - 1) {
+							fprintf(stderr, "cannot set multiple end dates per person!\n");
+							exit(-1);
+						}
+						config->people[person].last_day = rota_day_index;
+						break;
+
+					case CATEGORY_BANK_HOLIDAY:
+						set_bank_holiday(config, rota_day_index);
+						++config->total_bank_holidays_and_bias;
+						break;
+
+					case CATEGORY_BANK_HOLIDAY_BIAS:
+						config->people[person].bank_holiday_bias = atof(copy_field(&field, value, sizeof(value)));
+						break;
+
+					case CATEGORY_WARD_WEEK_BIAS:
+						config->people[person].ward_week_bias = atof(copy_field(&field, value, sizeof(value)));
+						break;
+
+					case CATEGORY_ON_CALL_DAY_BIAS:
+						config->people[person].on_call_day_bias = atof(copy_field(&field, value, sizeof(value)));
+						break;
+
+					case CATEGORY_ON_CALL_WEEKEND_BIAS:
+						config->people[person].on_call_weekend_bias = atof(copy_field(&field, value, sizeof(value)));
+						break;
+
+					case CATEGORY_NO_WARD_WEEKS:
+						config->people[person].cannot_do_ward_weeks = true;
+						break;
+
+					case CATEGORY_FORCE_ON_CALL_DAY:
+						if (config->forced_on_call_people[rota_day_index] != -1) {
+							fprintf(stderr, "multiple people are set as must be on call on the same day!\n");
+							exit(-1);
+						}
+						config->forced_on_call_people[rota_day_index] = person;
+						break;
+
+					default:
+						fprintf(stderr, "internal error: unknown category!\n");
+						exit(-1);
+						break;
+				}
+			}
+		}
+	}
+	csv_close(&csv);
+
+	// compute effective full time rate according to first and last days, biased totals
+	int const total_day_count = 7*config->week_count;
+	for (int person_index = 0; person_index < config->person_count; ++person_index) {
+		person_config_t *const person = &config->people[person_index];
+		for (int i = 0; i < person->first_day; ++i) {
+			set_holiday_day(config, i, person_index);
+		}
+		for (int i = person->first_day; i <= person->last_day; ++i) {
+			if (!is_holiday_day(config, i, person_index)) {
+				++person->total_non_holiday_days;
+			}
+		}
+		for (int i = person->last_day + 1; i < total_day_count; ++i) {
+			set_holiday_day(config, i, person_index);
+		}
+
+		int const person_day_count = 1 + person->last_day - person->first_day;
+		float const rota_amount = (float)person_day_count/(float)total_day_count;
+		person->effective_full_time_amount = person->full_time_amount*rota_amount;
+
+		if (person->cannot_do_ward_weeks && person->ward_week_bias != 0) {
+			fprintf(stderr, "person that cannot do ward weeks cannot have a ward week bias!\n");
+			exit(-1);
+		}
+
+		config->total_on_call_days_and_bias += person->on_call_day_bias;
+		config->total_on_call_weekends_and_bias += person->on_call_weekend_bias;
+		config->total_ward_weeks_and_bias += person->ward_week_bias;
+		config->total_bank_holidays_and_bias += person->bank_holiday_bias;
+		config->effective_on_call_person_count += person->effective_full_time_amount;
+		if (!person->cannot_do_ward_weeks) {
+			config->effective_ward_person_count += person->effective_full_time_amount;
+		}
+	}
+
+	// compute target working days and day off block sizes for each person
+	for (int person_index = 0; person_index < config->person_count; ++person_index) {
+		person_config_t *const person = &config->people[person_index];
+
+		float const on_call_ratio = person->effective_full_time_amount/config->effective_on_call_person_count;
+		float const ward_ratio = person->cannot_do_ward_weeks ? 0.f : (person->effective_full_time_amount/config->effective_ward_person_count);
+
+		person->target_on_call_days = on_call_ratio*config->total_on_call_days_and_bias;
+		person->target_on_call_weekends = on_call_ratio*config->total_on_call_weekends_and_bias;
+		person->target_ward_weeks = ward_ratio*config->total_ward_weeks_and_bias;
+		person->target_on_call_bank_holidays = on_call_ratio*config->total_bank_holidays_and_bias;
+
+		float const expected_on_call_days = person->target_on_call_days - person->on_call_day_bias;
+		float const expected_on_call_weekends = person->target_on_call_weekends - person->on_call_weekend_bias;
+		float const expected_ward_weeks = person->target_ward_weeks - person->ward_week_bias;
+
+		float const expected_working_days = expected_on_call_days + 2.f*expected_on_call_weekends + 5.f*expected_ward_weeks;
+
+		float const expected_follow_on_shifts = MIN(expected_ward_weeks, expected_on_call_weekends);
+		float const expected_shift_count = expected_on_call_days + expected_on_call_weekends + expected_ward_weeks - expected_follow_on_shifts;
+
+		person->target_day_off_block_size = (person->total_non_holiday_days - expected_working_days)/expected_shift_count;
+		person->target_ward_week_spacing = person->total_non_holiday_days/expected_ward_weeks;
+	}
+
+	// pack everything the sweep needs by day
+	build_day_records(config);
+	build_calendar(config);
+
+	// every shift of every week can change unless restricted later
+	config->active_week_count = config->week_count;
+	config->active_weeks = (int *)malloc(config->week_count*sizeof(int));
+	config->is_active_week = (bool *)malloc(config->week_count*sizeof(bool));
+	for (int i = 0; i < config->week_count; ++i) {
+		config->active_weeks[i] = i;
+	}
+	int const slot_count = config->week_count*SHIFT_COUNT;
+	config->fixed_shifts = (int *)malloc(slot_count*sizeof(int));
+	for (int i = 0; i < slot_count; ++i) {
+		config->fixed_shifts[i] = -1;
+	}
+	config->free_slots = (int *)malloc(slot_count*sizeof(int));
+	build_free_slots(config);
+}
+
+int find_person(config_t const *config, char const *name)
+{
+	for (int person = 0; person < config->person_count; ++person) {
+		if (strcmp(config->people[person].name, name) == 0) {
+			return person;
+		}
+	}
+	return -1;
+}
+
+void read_previous_rota(char const *filename, config_t *config)
+{
+	// parse the blocks of Date, On Call and Ward rows written by print_rota_csv
+	csv_t csv;
+	csv_open(&csv, filename);
+
+	int *const previous_shifts = (int *)malloc(config->week_count*SHIFT_COUNT*sizeof(int));
+	for (int i = 0; i < config->week_count*SHIFT_COUNT; ++i) {
+		previous_shifts[i] = -1;
+	}
+
+	tm_t const *const tm = localtime(&config->first_day);
+	int const first_day_number = get_day_number(tm->tm_mday, tm->tm_mon + 1, tm->tm_year + EPOCH_YEAR);
+	int week_index = -1;
+	int known_count = 0;
+	int unknown_name_count = 0;
+	csv_field_t field;
+	while (csv_next_row(&csv) && csv_next_field(&csv, &field)) {
+		if (is_field(&field, "Date")) {
+			// weeks outside this rota are skipped
+			week_index = -1;
+			if (csv_next_field(&csv, &field)) {
+				char date[MAX_FIELD_LENGTH];
+				int day, month, year;
+				parse_date_parts(copy_field(&field, date, sizeof(date)), &day, &month, &year);
+				int const rota_day_index = get_day_number(day, month, year) - first_day_number;
+				if (rota_day_index >= 0 && (rota_day_index % 7) == 0 && rota_day_index < 7*config->week_count) {
+					week_index = rota_day_index/7;
+				}
+			}
+			continue;
+		}
+		bool const is_on_call = is_field(&field, "On Call");
+		bool const is_ward = is_field(&field, "Ward");
+		if (week_index == -1 || !(is_on_call || is_ward)) {
+			continue;
+		}
+		for (int day_index = 0; day_index < (is_on_call ? 6 : 1) && csv_next_field(&csv, &field); ++day_index) {
+			char name[MAX_PERSON_NAME_LENGTH];
+			int const shift = is_ward ? SHIFT_WARD_WEEK : MIN(day_index, SHIFT_ON_CALL_WEEKEND);
+			int const person = (field.length < MAX_PERSON_NAME_LENGTH) ? find_person(config, copy_field(&field, name, sizeof(name))) : -1;
+			if (person == -1) {
+				++unknown_name_count;
+			} else {
+				previous_shifts[week_index*SHIFT_COUNT + shift] = person;
+				++known_count;
+			}
+		}
+	}
+	csv_close(&csv);
+
+	if (known_count == 0) {
+		fprintf(stderr, "no shifts in \"%s\" match this rota!\n", filename);
+		exit(-1);
+	}
+	if (unknown_name_count > 0) {
+		printf("%d shifts in \"%s\" are for people not in this rota\n", unknown_name_count, filename);
+	}
+	config->previous_shifts = previous_shifts;
+}
+
+enum
+{
+	CHANNEL_HOLIDAY,
+	CHANNEL_FORCED_ON_CALL,
+	CHANNEL_CANNOT_ON_CALL,
+	CHANNEL_DISLIKE_ON_CALL,
+	CHANNEL_CANNOT_WARD_WEEK,
+	CHANNEL_DISLIKE_WARD_WEEK,
+	CHANNEL_COUNT
+};
+
+static char const *const g_channel_names[CHANNEL_COUNT] =
+{
+	NAME_HOLIDAY,
+	NAME_FORCE_ON_CALL_DAY,
+	NAME_CANNOT_ON_CALL_DAY,
+	NAME_DISLIKE_ON_CALL_DAY,
+	NAME_CANNOT_WARD_WEEK,
+	NAME_DISLIKE_WARD_WEEK
+};
+
+void print_config_html(config_t const *config, points_t const *points, char const *filename)
+{
+	writer_t *const writer = open_writer(filename);
+
+	write_html_header(writer, "Rota Input");
+	write_string(writer, "<table>\n<tr>\n<th>Name</th><th>Category</th>\n");
+	write_html_week_headings(writer, config);
+	write_string(writer, "</tr>\n");
+
+	for (int person_index = 0; person_index < config->person_count; ++person_index) {
+		person_config_t const *const person = &config->people[person_index];
+		for (int channel = 0; channel < CHANNEL_COUNT; ++channel) {
+			write_string(writer, "<tr>");
+			if (channel == 0) {
+				write_format(writer, "<td rowspan=\"%d\" class=\"n\"><strong>%s</strong>", CHANNEL_COUNT, person->name);
+				if (person->full_time_amount != 1.f) {
+					write_format(writer, "<br>%s: %f", NAME_PART_TIME, person->full_time_amount);
+				}
+				if (person->on_call_day_bias != 0.f) {
+					write_format(writer, "<br>%s: %f", NAME_ON_CALL_DAY_BIAS, person->on_call_day_bias);
+				}
+				if (person->on_call_weekend_bias != 0.f) {
+					write_format(writer, "<br>%s: %f", NAME_ON_CALL_WEEKEND_BIAS, person->on_call_weekend_bias);
+				}
+				if (person->ward_week_bias != 0.f) {
+					write_format(writer, "<br>%s: %f", NAME_WARD_WEEK_BIAS, person->ward_week_bias);
+				}
+				if (person->bank_holiday_bias != 0.f) {
+					write_format(writer, "<br>%s: %f", NAME_BANK_HOLIDAY_BIAS, person->bank_holiday_bias);
+				}
+				if (person->cannot_do_ward_weeks) {
+					write_format(writer, "<br>%s", NAME_NO_WARD_WEEKS);
+				}
+				write_string(writer, "</td>\n");
+			}
+			write_string(writer, "<td class=\"n\">");
+			write_string(writer, g_channel_names[channel]);
+			write_string(writer, "</td>\n");
+			for (int week_index = 0; week_index < config->week_count; ++week_index) {
+				for (int weekday_index = 0; weekday_index < 7; ++weekday_index) {
+					int const rota_day_index = 7*week_index + weekday_index;
+					char const *class_name = get_calendar_class(&config->calendar[rota_day_index]);
+					switch (channel) {
+						case CHANNEL_HOLIDAY:
+							if (rota_day_index < person->first_day || person->last_day < rota_day_index) {
+								class_name = "x";
+							} else if (is_holiday_day(config, rota_day_index, person_index)) {
+								class_name = "h";
+							}
+							break;
+
+						case CHANNEL_FORCED_ON_CALL:
+							if (config->forced_on_call_people[rota_day_index] == person_index) {
+								class_name = "f";
+							}
+							break;
+
+						case CHANNEL_CANNOT_ON_CALL:
+							if (is_invalid_on_call_day(config, rota_day_index, person_index)) {
+								class_name = "i";
+							}
+							break;
+
+						case CHANNEL_DISLIKE_ON_CALL:
+							if (is_disliked_on_call_day(config, rota_day_index, person_index)) {
+								class_name = "c";
+							}
+							break;
+
+						case CHANNEL_CANNOT_WARD_WEEK:
+							if (weekday_index < 5 && is_invalid_ward_week(config, week_index, person_index)) {
+								class_name = "o";
+							}
+							break;
+
+						case CHANNEL_DISLIKE_WARD_WEEK:
+							if (weekday_index < 5 && is_disliked_ward_week(config, week_index, person_index)) {
+								class_name = "w";
+							}
+							break;
+					}
+					write_html_cell(writer, class_name, "");
+				}
+				write_string(writer, "\n");
+			}
+			write_string(writer, "</tr>\n");
+		}
+	}
+	write_string(writer, "<table>\n");
+
+	write_string(writer, "<h1>Points</h1>\n<table>\n<tr><th>Name</th><th>Value</th></tr>");
+	for (int i = 0; i < POINTS_COUNT; ++i) {
+		write_format(writer, "<tr><td>%s</td><td>%f</td>\n", g_points_names[i], points->values[i]);
+	}
+	write_string(writer, "</table>\n");
+
+	write_string(writer, "</body>\n</html>\n");
+	close_writer(writer);
+
+	printf("written input to \"%s\"\n", filename);
+}
+
+typedef struct
+{
+	rota_t *rota;
+	score_t *score;
+} state_t;
+
+void read_points(char const *filename, config_t const *config, points_t *points)
+{
+	memset(points, 0, sizeof(points_t));
+
+	csv_t csv;
+	csv_open(&csv, filename);
+	name_hash_t points_hash;
+	init_name_hash(&points_hash, g_points_names, POINTS_COUNT);
+
+	csv_field_t field;
+	while (csv_next_row(&csv)) {
+		if (!csv_next_field(&csv, &field) || field.length == 0) {
+			continue;
+		}
+		int const index = find_name(&points_hash, &field);
+		if (index == -1) {
+			fprintf(stderr, "unknown points \"%.*s\"!\n", field.length, field.start);
+			exit(-1);
+		}
+		char value[MAX_FIELD_LENGTH];
+		if (!csv_next_field(&csv, &field)) {
+			fprintf(stderr, "points \"%s\" has no value!\n", g_points_names[index]);
+			exit(-1);
+		}
+		points->values[index] = (float)atof(copy_field(&field, value, sizeof(value)));
+	}
+	csv_close(&csv);
+
+	// tabulate the gap scores over the whole horizon, and the per shift penalties
+	points->max_day_gap = 7*config->week_count + 1;
+	points->max_week_gap = config->week_count + 1;
+	points->days_off_scores = build_decay_table(points->values[POINTS_DAY_OFF], points->values[POINTS_DAY_OFF_DECAY], points->max_day_gap);
+	points->no_ward_week_scores = build_decay_table(points->values[POINTS_NO_WARD_WEEK], points->values[POINTS_NO_WARD_WEEK_DECAY], points->max_week_gap);
+	build_slot_penalties(config, points);
+	build_eligible_people(config, points);
+}
+
+void restrict_to_changed_weeks(config_t *config, points_t const *points, int window)
+{
+	// find weeks where the previous rota is incomplete or now breaks hard
+	// constraints, using person 0 as a stand in for unknown shifts
+	rota_t *const rota = alloc_rota(config);
+	bool *const is_changed = (bool *)calloc(config->week_count, sizeof(bool));
+	for (int week_index = 0; week_index < config->week_count; ++week_index) {
+		for (int shift = 0; shift < SHIFT_COUNT; ++shift) {
+			int const person = config->previous_shifts[week_index*SHIFT_COUNT + shift];
+			rota->weeks[week_index].shifts[shift] = MAX(person, 0);
+			if (person == -1) {
+				is_changed[week_index] = true;
+			}
+		}
+	}
+	for (int week_index = 0; week_index < config->week_count; ++week_index) {
+		int failure_count;
+		score_week_local(config, points, rota, week_index, &failure_count);
+		if (failure_count > 0) {
+			is_changed[week_index] = true;
+		}
+	}
+
+	// mutate near those weeks, or everywhere if nothing is broken
+	config->active_week_count = 0;
+	for (int week_index = 0; week_index < config->week_count; ++week_index) {
+		for (int i = MAX(week_index - window, 0); i <= MIN(week_index + window, config->week_count - 1); ++i) {
+			if (is_changed[i]) {
+				config->active_weeks[config->active_week_count++] = week_index;
+				break;
+			}
+		}
+	}
+	if (config->active_week_count == 0) {
+		config->active_week_count = config->week_count;
+		for (int i = 0; i < config->week_count; ++i) {
+			config->active_weeks[i] = i;
+		}
+	}
+	printf("changing %d of %d weeks of the previous rota\n", config->active_week_count, config->week_count);
+	build_free_slots(config);
+	free(is_changed);
+	free(rota);
+}
+
+/*
+	Presolve.
+
+	Some shifts are decided by the input alone, such as a forced on call day
+	or a ward week only one person can do.  Starting from the people eligible
+	for each shift, a shift with a single candidate is fixed to them, and
+	they are removed from the shifts that would clash with it (the days on
+	call either side, or a ward week and the on calls during it), which can
+	leave other shifts with a single candidate in turn.  Fixed shifts are
+	filled in up front and never mutated, and the remaining shifts draw
+	reassignments from whoever is left.
+*/
+
+void presolve(config_t *config, points_t *points)
+{
+	int const slot_count = config->week_count*SHIFT_COUNT;
+	int const word_count = points->eligible_word_count;
+	int *const queue = (int *)malloc(slot_count*sizeof(int));
+	int queue_length = 0;
+	for (int slot = 0; slot < slot_count; ++slot) {
+		if (points->eligible_counts[slot] == 1) {
+			queue[queue_length++] = slot;
+		}
+	}
+
+	// each shift joins the queue at most once, when it gets down to one candidate
+	int fixed_count = 0;
+	for (int i = 0; i < queue_length; ++i) {
+		int const slot = queue[i];
+		if (points->eligible_counts[slot] != 1) {
+			continue;
+		}
+		uint64_t const *const words = &points->eligible_people[slot*word_count];
+		int word_index = 0;
+		while (words[word_index] == 0) {
+			++word_index;
+		}
+		int const person = 64*word_index + select_bit(words[word_index], 0);
+		config->fixed_shifts[slot] = person;
+		++fixed_count;
+
+		int slots[MAX_CLASHING_SLOTS];
+		int const clashing_count = get_clashing_slots(config, slot, slots);
+		for (int j = 0; j < clashing_count; ++j) {
+			int const other_slot = slots[j];
+			uint64_t *const word = &points->eligible_people[other_slot*word_count + person/64];
+			uint64_t const bit = 1ULL << (person % 64);
+			if ((*word & bit) != 0 && config->fixed_shifts[other_slot] == -1) {
+				*word &= ~bit;
+				if (--points->eligible_counts[other_slot] == 1) {
+					queue[queue_length++] = other_slot;
+				}
+			}
+		}
+	}
+
+	// shifts that nobody can take without breaking a hard constraint
+	int empty_count = 0;
+	for (int slot = 0; slot < slot_count; ++slot) {
+		if (points->eligible_counts[slot] == 0) {
+			++empty_count;
+		}
+	}
+	printf("fixed %d of %d shifts from the input", fixed_count, slot_count);
+	if (empty_count > 0) {
+		printf(", %d shifts have nobody available", empty_count);
+	}
+	printf("\n");
+	build_free_slots(config);
+	free(queue);
+}
+
+#ifdef _WIN32
+typedef HANDLE thread_t;
+typedef LPTHREAD_START_ROUTINE thread_func_t;
+typedef CRITICAL_SECTION mutex_t;
+typedef CONDITION_VARIABLE cond_t;
+#define THREAD_FUNC(NAME, ARG)		DWORD WINAPI NAME(LPVOID ARG)
+#define THREAD_RETURN				0
+#else
+typedef pthread_t thread_t;
+typedef void *(*thread_func_t)(void *);
+typedef pthread_mutex_t mutex_t;
+typedef pthread_cond_t cond_t;
+#define THREAD_FUNC(NAME, ARG)		void *NAME(void *ARG)
+#define THREAD_RETURN				NULL
+#endif
+
+double get_seconds(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER frequency, counter;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	return (double)counter.QuadPart/(double)frequency.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + 1e-9*(double)ts.tv_nsec;
+#endif
+}
+
+void thread_start(thread_t *thread, thread_func_t func, void *arg)
+{
+#ifdef _WIN32
+	*thread = CreateThread(NULL, 0, func, arg, 0, NULL);
+	bool const ok = (*thread != NULL);
+#else
+	bool const ok = (pthread_create(thread, NULL, func, arg) == 0);
+#endif
+	if (!ok) {
+		fprintf(stderr, "failed to start thread!\n");
+		exit(-1);
+	}
+}
+
+void thread_join(thread_t *thread)
+{
+#ifdef _WIN32
+	WaitForSingleObject(*thread, INFINITE);
+	CloseHandle(*thread);
+#else
+	pthread_join(*thread, NULL);
+#endif
+}
+
+void mutex_init(mutex_t *mutex)
+{
+#ifdef _WIN32
+	InitializeCriticalSection(mutex);
+#else
+	pthread_mutex_init(mutex, NULL);
+#endif
+}
+
+void mutex_destroy(mutex_t *mutex)
+{
+#ifdef _WIN32
+	DeleteCriticalSection(mutex);
+#else
+	pthread_mutex_destroy(mutex);
+#endif
+}
+
+void mutex_lock(mutex_t *mutex)
+{
+#ifdef _WIN32
+	EnterCriticalSection(mutex);
+#else
+	pthread_mutex_lock(mutex);
+#endif
+}
+
+void mutex_unlock(mutex_t *mutex)
+{
+#ifdef _WIN32
+	LeaveCriticalSection(mutex);
+#else
+	pthread_mutex_unlock(mutex);
+#endif
+}
+
+void cond_init(cond_t *cond)
+{
+#ifdef _WIN32
+	InitializeConditionVariable(cond);
+#else
+	pthread_cond_init(cond, NULL);
+#endif
+}
+
+void cond_destroy(cond_t *cond)
+{
+#ifdef _WIN32
+	(void)cond;
+#else
+	pthread_cond_destroy(cond);
+#endif
+}
+
+void cond_wait(cond_t *cond, mutex_t *mutex)
+{
+#ifdef _WIN32
+	SleepConditionVariableCS(cond, mutex, INFINITE);
+#else
+	pthread_cond_wait(cond, mutex);
+#endif
+}
+
+void cond_broadcast(cond_t *cond)
+{
+#ifdef _WIN32
+	WakeAllConditionVariable(cond);
+#else
+	pthread_cond_broadcast(cond);
+#endif
+}
+
+typedef struct
+{
+	mutex_t mutex;
+	cond_t cond;
+	int thread_count;
+	int waiting_count;
+	int generation;
+} barrier_t;
+
+void barrier_init(barrier_t *barrier, int thread_count)
+{
+	mutex_init(&barrier->mutex);
+	cond_init(&barrier->cond);
+	barrier->thread_count = thread_count;
+	barrier->waiting_count = 0;
+	barrier->generation = 0;
+}
+
+void barrier_destroy(barrier_t *barrier)
+{
+	cond_destroy(&barrier->cond);
+	mutex_destroy(&barrier->mutex);
+}
+
+bool barrier_wait(barrier_t *barrier)
+{
+	// returns true for exactly one of the threads, like PTHREAD_BARRIER_SERIAL_THREAD
+	mutex_lock(&barrier->mutex);
+	int const generation = barrier->generation;
+	bool const is_last = (++barrier->waiting_count == barrier->thread_count);
+	if (is_last) {
+		barrier->waiting_count = 0;
+		++barrier->generation;
+		cond_broadcast(&barrier->cond);
+	} else {
+		while (generation == barrier->generation) {
+			cond_wait(&barrier->cond, &barrier->mutex);
+		}
+	}
+	mutex_unlock(&barrier->mutex);
+	return is_last;
+}
+
+#if COLLECT_STATS
+
+static stats_t g_stats;
+static mutex_t g_stats_mutex;
+
+void merge_thread_stats(void)
+{
+	mutex_lock(&g_stats_mutex);
+	for (int i = 0; i < MOVE_COUNT; ++i) {
+		g_stats.move_proposal_counts[i] += g_thread_stats.move_proposal_counts[i];
+		g_stats.move_accept_counts[i] += g_thread_stats.move_accept_counts[i];
+		g_stats.move_improvement_counts[i] += g_thread_stats.move_improvement_counts[i];
+	}
+	for (int i = 0; i < POINTS_COUNT; ++i) {
+		g_stats.points_counts[i] += g_thread_stats.points_counts[i];
+	}
+	for (int i = 0; i < SECTION_COUNT; ++i) {
+		g_stats.section_counts[i] += g_thread_stats.section_counts[i];
+		g_stats.section_cycles[i] += g_thread_stats.section_cycles[i];
+	}
+	memset(&g_thread_stats, 0, sizeof(stats_t));
+	mutex_unlock(&g_stats_mutex);
+}
+
+void print_stats_json(char const *filename)
+{
+	FILE *const fp = fopen(filename, "w");
+	if (!fp) {
+		fprintf(stderr, "failed to open \"%s\" for writing!\n", filename);
+		exit(-1);
+	}
+	fprintf(fp, "{\n\t\"moves\": {\n");
+	for (int i = 0; i < MOVE_COUNT; ++i) {
+		fprintf(fp, "\t\t\"%s\": { \"proposals\": %lld, \"accepts\": %lld, \"improvements\": %lld }%s\n",
+			g_move_names[i],
+			(long long)g_stats.move_proposal_counts[i],
+			(long long)g_stats.move_accept_counts[i],
+			(long long)g_stats.move_improvement_counts[i],
+			(i + 1 < MOVE_COUNT) ? "," : "");
+	}
+	fprintf(fp, "\t},\n\t\"points\": {\n");
+	for (int i = 0; i < POINTS_COUNT; ++i) {
+		fprintf(fp, "\t\t\"%s\": %lld%s\n",
+			g_points_names[i],
+			(long long)g_stats.points_counts[i],
+			(i + 1 < POINTS_COUNT) ? "," : "");
+	}
+	fprintf(fp, "\t},\n\t\"sections\": {\n");
+	for (int i = 0; i < SECTION_COUNT; ++i) {
+		int64_t const count = g_stats.section_counts[i];
+		fprintf(fp, "\t\t\"%s\": { \"calls\": %lld, \"cycles\": %llu, \"cycles_per_call\": %.1f }%s\n",
+			g_section_names[i],
+			(long long)count,
+			(unsigned long long)g_stats.section_cycles[i],
+			(count > 0) ? ((double)g_stats.section_cycles[i]/(double)count) : 0.0,
+			(i + 1 < SECTION_COUNT) ? "," : "");
+	}
+	fprintf(fp, "\t}\n}\n");
+	fclose(fp);
+	printf("written statistics to \"%s\"\n", filename);
+}
+
+#define STATS_MERGE_THREAD()		merge_thread_stats()
+
+#else
+
+#define STATS_MERGE_THREAD()		((void)0)
+
+#endif // COLLECT_STATS
+
+#define DEFAULT_SEED				0xABCD0123U
+#define DEFAULT_RUN_COUNT			(6*1024*1024)
+#define DEFAULT_REPAIR_RUN_COUNT	(256*1024)
+#define DEFAULT_FROM_WINDOW			0
+#define MAX_THREAD_COUNT			64
+#define MAX_REPLICA_COUNT			64
+#define MAX_RESTART_COUNT			4096
+#define DEFAULT_EXCHANGE_INTERVAL	1024
+#define ANNEAL_CALIBRATION_COUNT	1024
+#define ANNEAL_INITIAL_ACCEPTANCE	.5f
+#define ANNEAL_WARM_INITIAL_ACCEPTANCE	.02f
+#define ANNEAL_FINAL_ACCEPTANCE		.01f
+#define ANNEAL_MAX_FINAL_RATIO		.01f
+#define ANNEAL_STEP_LENGTH			1024
+#define DEFAULT_TRACE_INTERVAL		4096
+#define DEFAULT_CHECKPOINT_INTERVAL	5.0
+#define TRACE_BUFFER_SIZE			(1024*1024)
+#define DEFAULT_MIN_TEMPERATURE		.05f
+#define DEFAULT_MAX_TEMPERATURE		50.f
+
+typedef enum
+{
+	SCHEDULE_ANNEAL,
+	SCHEDULE_HALF_LIFE,
+
+	SCHEDULE_COUNT
+} schedule_t;
+
+static char const *const g_schedule_names[SCHEDULE_COUNT] =
+{
+	"anneal",
+	"half-life",
+};
+
+typedef enum
+{
+	INIT_CONSTRUCTIVE,
+	INIT_RANDOM,
+
+	INIT_COUNT
+} init_t;
+
+static char const *const g_init_names[INIT_COUNT] =
+{
+	"constructive",
+	"random",
+};
+
+typedef enum
+{
+	MOVES_ADAPTIVE,
+	MOVES_FIXED,
+
+	MOVES_COUNT
+} move_selection_t;
+
+static char const *const g_move_selection_names[MOVES_COUNT] =
+{
+	"adaptive",
+	"fixed",
+};
+
+typedef enum
+{
+	STOP_MAX_ITERATIONS,
+	STOP_TIME_LIMIT,
+	STOP_STALL_ITERATIONS,
+	STOP_TARGET_SCORE,
+
+	STOP_COUNT
+} stop_reason_t;
+
+static char const *const g_stop_reason_names[STOP_COUNT] =
+{
+	"iteration limit reached",
+	"time limit reached",
+	"no improvement within the stall limit",
+	"target score reached",
+};
+
+typedef struct
+{
+	// summed over the chains that learned a mix
+	int chain_count;
+	double probabilities[MOVE_COUNT];
+	int64_t use_counts[MOVE_COUNT];
+} move_mix_t;
+
+typedef struct
+{
+	stop_reason_t stop_reason;
+	int64_t iteration_count;
+	double seconds;
+	int64_t first_valid_iteration;
+	double first_valid_seconds;
+	move_mix_t move_mix;
+} run_stats_t;
+
+typedef struct
+{
+	char const *input_filename;
+	char const *summary_filename;
+	char const *stats_filename;
+	char const *trace_filename;
+	int trace_interval;
+	char const *checkpoint_filename;
+	double checkpoint_interval;
+	char const *resume_filename;
+	char const *from_filename;
+	int from_window;
+	uint64_t seed;
+	schedule_t schedule;
+	int64_t max_iterations;
+	double time_limit;
+	int stall_iterations;
+	bool has_target_score;
+	float target_score;
+	int restart_count;
+	int replica_count;
+	int thread_count;
+	int temperature_count;
+	float temperatures[MAX_REPLICA_COUNT];
+	int exchange_interval;
+	int batch_size;
+	float repair_rate;
+	move_selection_t move_selection;
+	init_t init;
+	bool bench_score;
+	bool bench_kernels;
+} options_t;
+
+void print_usage(void)
+{
+	fprintf(stderr, "usage: rota [options] [input.csv]\n\
+options:\n\
+  --seed N               seed for the random number generator (default: %#x)\n\
+  --schedule NAME        acceptance schedule for a single chain or restarts, either\n\
+                         \"anneal\" for metropolis with a calibrated geometric cooling\n\
+                         or \"half-life\" for the original schedule (default: anneal)\n\
+  --max-iterations N     iterations to run for, split between any replicas\n\
+                         (default: %d, or %d with --from, or no limit with\n\
+                         --time-limit)\n\
+  --time-limit SECONDS   stop after this long, annealing cools over this time\n\
+  --stall-iterations N   also stop after N iterations without a better rota\n\
+  --target-score X       also stop once a valid rota scores at least X\n\
+                         (with restarts, these limits apply to each restart)\n\
+  --restarts N           run N independent searches and keep the best (at most %d)\n\
+  --replicas N           run parallel tempering with N replicas (at most %d)\n\
+  --threads N            number of threads to run the restarts or replicas on\n\
+                         (default: one per replica, or one for restarts, at most %d)\n\
+  --temperatures A,B,... temperature ladder, either one per replica or the coldest\n\
+                         and hottest of a geometric ladder (default: %g,%g)\n\
+  --exchange-interval N  iterations between replica exchanges (default: %d)\n\
+  --batch N              choose each reassignment from N candidates by fewest hard\n\
+                         constraints broken (default: 1, at most %d)\n\
+  --from FILE            start from a previous output.csv, penalise each changed shift\n\
+                         and only change weeks near those it no longer fits\n\
+  --from-window N        weeks either side of those that can also change (default: %d)\n\
+  --init NAME            starting rota, either \"constructive\" to fill each shift\n\
+                         with someone who fits and is furthest below their target\n\
+                         or \"random\" (default: constructive)\n\
+  --moves NAME           how to choose each move, either \"adaptive\" to favour the\n\
+                         moves that are improving the rota at the time or \"fixed\"\n\
+                         for a fixed mix (default: fixed)\n\
+  --repair-rate F        chance of a move going to a week with failures while there\n\
+                         are any, for a fixed mix (default: %g)\n\
+  --summary FILE         append a line of run statistics to a CSV file\n\
+  --trace FILE           write a CSV of the search every trace interval iterations,\n\
+                         for a single chain only\n\
+  --trace-interval N     iterations between trace samples (default: %d)\n\
+  --checkpoint FILE      periodically save the state of a single chain to a file\n\
+  --checkpoint-interval SECONDS\n\
+                         time between checkpoints (default: %g)\n\
+  --resume FILE          continue a single chain from a checkpoint, which needs the\n\
+                         same input and search options as the run that saved it\n\
+  --stats FILE           where to write move and scoring counters as JSON, when\n\
+                         built with COLLECT_STATS=1 (default: stats.json)\n\
+  --bench-score          time score_rota on random rotas for the input and exit\n\
+  --bench-kernels        time score_rota, the mutations, rota_rand and the\n\
+                         acceptance test for the input and exit\n\
+",
+		DEFAULT_SEED,
+		DEFAULT_RUN_COUNT,
+		DEFAULT_REPAIR_RUN_COUNT,
+		MAX_RESTART_COUNT,
+		MAX_REPLICA_COUNT,
+		MAX_THREAD_COUNT,
+		DEFAULT_MIN_TEMPERATURE, DEFAULT_MAX_TEMPERATURE,
+		DEFAULT_EXCHANGE_INTERVAL,
+		MAX_BATCH_SIZE,
+		DEFAULT_FROM_WINDOW,
+		DEFAULT_REPAIR_RATE,
+		DEFAULT_TRACE_INTERVAL,
+		DEFAULT_CHECKPOINT_INTERVAL);
+}
+
+int parse_int_option(char const *name, char const *value, int min_value, int max_value)
+{
+	char *end = NULL;
+	long const result = value ? strtol(value, &end, 10) : 0;
+	if (!value || *end != '\0' || result < min_value || max_value < result) {
+		fprintf(stderr, "option %s expects an integer from %d to %d!\n", name, min_value, max_value);
+		exit(-1);
+	}
+	return (int)result;
+}
+
+double parse_double_option(char const *name, char const *value, bool must_be_positive)
+{
+	char *end = NULL;
+	double const result = value ? strtod(value, &end) : 0.0;
+	if (!value || end == value || *end != '\0' || (must_be_positive && !(result > 0.0))) {
+		fprintf(stderr, "option %s expects a %snumber!\n", name, must_be_positive ? "positive " : "");
+		exit(-1);
+	}
+	return result;
+}
+
+uint64_t parse_seed_option(char const *name, char const *value)
+{
+	char *end = NULL;
+	unsigned long long const result = value ? strtoull(value, &end, 0) : 0;
+	if (!value || *value == '-' || *end != '\0') {
+		fprintf(stderr, "option %s expects a non-negative integer!\n", name);
+		exit(-1);
+	}
+	return (uint64_t)result;
+}
+
+schedule_t parse_schedule_option(char const *name, char const *value)
+{
+	for (int i = 0; value && i < SCHEDULE_COUNT; ++i) {
+		if (strcmp(value, g_schedule_names[i]) == 0) {
+			return (schedule_t)i;
+		}
+	}
+	fprintf(stderr, "option %s expects \"%s\" or \"%s\"!\n", name, g_schedule_names[SCHEDULE_ANNEAL], g_schedule_names[SCHEDULE_HALF_LIFE]);
+	exit(-1);
+}
+
+init_t parse_init_option(char const *name, char const *value)
+{
+	for (int i = 0; value && i < INIT_COUNT; ++i) {
+		if (strcmp(value, g_init_names[i]) == 0) {
+			return (init_t)i;
+		}
+	}
+	fprintf(stderr, "option %s expects \"%s\" or \"%s\"!\n", name, g_init_names[INIT_CONSTRUCTIVE], g_init_names[INIT_RANDOM]);
+	exit(-1);
+}
+
+move_selection_t parse_move_selection_option(char const *name, char const *value)
+{
+	for (int i = 0; value && i < MOVES_COUNT; ++i) {
+		if (strcmp(value, g_move_selection_names[i]) == 0) {
+			return (move_selection_t)i;
+		}
+	}
+	fprintf(stderr, "option %s expects \"%s\" or \"%s\"!\n", name, g_move_selection_names[MOVES_ADAPTIVE], g_move_selection_names[MOVES_FIXED]);
+	exit(-1);
+}
+
+int parse_float_list_option(char const *name, char const *value, float *values, int max_count)
+{
+	int count = 0;
+	char const *p = value;
+	while (p) {
+		char *end = NULL;
+		float const x = (count < max_count) ? strtof(p, &end) : 0.f;
+		if (count == max_count || end == p || (*end != ',' && *end != '\0') || !(x > 0.f)) {
+			fprintf(stderr, "option %s expects a list of at most %d positive numbers!\n", name, max_count);
+			exit(-1);
+		}
+		values[count++] = x;
+		p = (*end == ',') ? (end + 1) : NULL;
+	}
+	return count;
+}
+
+void parse_options(int argc, char *argv[], options_t *options)
+{
+	memset(options, 0, sizeof(options_t));
+	options->input_filename = "input.csv";
+	options->seed = DEFAULT_SEED;
+	options->max_iterations = DEFAULT_RUN_COUNT;
+	options->stats_filename = "stats.json";
+	options->trace_interval = DEFAULT_TRACE_INTERVAL;
+	options->checkpoint_interval = DEFAULT_CHECKPOINT_INTERVAL;
+	options->exchange_interval = DEFAULT_EXCHANGE_INTERVAL;
+	options->batch_size = 1;
+	options->repair_rate = DEFAULT_REPAIR_RATE;
+	options->move_selection = MOVES_FIXED;
+	options->from_window = DEFAULT_FROM_WINDOW;
+
+	bool has_input_filename = false;
+	bool has_max_iterations = false;
+	for (int i = 1; i < argc; ++i) {
+		char const *const arg = argv[i];
+		if (strncmp(arg, "--", 2) != 0) {
+			if (has_input_filename) {
+				print_usage();
+				exit(-1);
+			}
+			options->input_filename = arg;
+			has_input_filename = true;
+			continue;
+		}
+		if (strcmp(arg, "--bench-score") == 0) {
+			options->bench_score = true;
+			continue;
+		}
+		if (strcmp(arg, "--bench-kernels") == 0) {
+			options->bench_kernels = true;
+			continue;
+		}
+		char const *const value = (i + 1 < argc) ? argv[i + 1] : NULL;
+		if (strcmp(arg, "--seed") == 0) {
+			options->seed = parse_seed_option(arg, value);
+		} else if (strcmp(arg, "--schedule") == 0) {
+			options->schedule = parse_schedule_option(arg, value);
+		} else if (strcmp(arg, "--init") == 0) {
+			options->init = parse_init_option(arg, value);
+		} else if (strcmp(arg, "--moves") == 0) {
+			options->move_selection = parse_move_selection_option(arg, value);
+		} else if (strcmp(arg, "--summary") == 0) {
+			options->summary_filename = value;
+			if (!value) {
+				fprintf(stderr, "option %s expects a filename!\n", arg);
+				exit(-1);
+			}
+		} else if (strcmp(arg, "--trace") == 0) {
+			options->trace_filename = value;
+			if (!value) {
+				fprintf(stderr, "option %s expects a filename!\n", arg);
+				exit(-1);
+			}
+		} else if (strcmp(arg, "--checkpoint") == 0 || strcmp(arg, "--resume") == 0) {
+			if (!value) {
+				fprintf(stderr, "option %s expects a filename!\n", arg);
+				exit(-1);
+			}
+			if (arg[2] == 'c') {
+				options->checkpoint_filename = value;
+			} else {
+				options->resume_filename = value;
+			}
+		} else if (strcmp(arg, "--checkpoint-interval") == 0) {
+			options->checkpoint_interval = parse_double_option(arg, value, true);
+		} else if (strcmp(arg, "--trace-interval") == 0) {
+			options->trace_interval = parse_int_option(arg, value, 1, INT_MAX);
+		} else if (strcmp(arg, "--stats") == 0) {
+			options->stats_filename = value;
+			if (!value || !COLLECT_STATS) {
+				fprintf(stderr, "option %s expects a filename and a build with COLLECT_STATS=1!\n", arg);
+				exit(-1);
+			}
+		} else if (strcmp(arg, "--max-iterations") == 0) {
+			options->max_iterations = parse_int_option(arg, value, 1, INT_MAX);
+			has_max_iterations = true;
+		} else if (strcmp(arg, "--from") == 0) {
+			if (!value) {
+				fprintf(stderr, "option %s expects a filename!\n", arg);
+				exit(-1);
+			}
+			options->from_filename = value;
+		} else if (strcmp(arg, "--repair-rate") == 0) {
+			options->repair_rate = (float)parse_double_option(arg, value, false);
+			if (options->repair_rate < 0.f || 1.f < options->repair_rate) {
+				fprintf(stderr, "option %s expects a rate between 0 and 1!\n", arg);
+				exit(-1);
+			}
+		} else if (strcmp(arg, "--from-window") == 0) {
+			options->from_window = parse_int_option(arg, value, 0, INT_MAX);
+		} else if (strcmp(arg, "--time-limit") == 0) {
+			options->time_limit = parse_double_option(arg, value, true);
+		} else if (strcmp(arg, "--stall-iterations") == 0) {
+			options->stall_iterations = parse_int_option(arg, value, 1, INT_MAX);
+		} else if (strcmp(arg, "--target-score") == 0) {
+			options->target_score = (float)parse_double_option(arg, value, false);
+			options->has_target_score = true;
+		} else if (strcmp(arg, "--restarts") == 0) {
+			options->restart_count = parse_int_option(arg, value, 1, MAX_RESTART_COUNT);
+		} else if (strcmp(arg, "--replicas") == 0) {
+			options->replica_count = parse_int_option(arg, value, 1, MAX_REPLICA_COUNT);
+		} else if (strcmp(arg, "--threads") == 0) {
+			options->thread_count = parse_int_option(arg, value, 1, MAX_THREAD_COUNT);
+		} else if (strcmp(arg, "--temperatures") == 0) {
+			options->temperature_count = parse_float_list_option(arg, value, options->temperatures, MAX_REPLICA_COUNT);
+		} else if (strcmp(arg, "--batch") == 0) {
+			options->batch_size = parse_int_option(arg, value, 1, MAX_BATCH_SIZE);
+		} else if (strcmp(arg, "--exchange-interval") == 0) {
+			options->exchange_interval = parse_int_option(arg, value, 1, INT_MAX);
+		} else {
+			if (strcmp(arg, "--help") != 0) {
+				fprintf(stderr, "unknown option \"%s\"!\n", arg);
+			}
+			print_usage();
+			exit(-1);
+		}
+		++i;
+	}
+
+	if (options->restart_count > 0 && options->replica_count > 0) {
+		fprintf(stderr, "options --restarts and --replicas cannot be combined!\n");
+		exit(-1);
+	}
+	if (options->time_limit > 0.0 && !has_max_iterations) {
+		// the time limit is the budget, however many iterations that takes
+		options->max_iterations = 0;
+	} else if (options->from_filename && !has_max_iterations) {
+		options->max_iterations = DEFAULT_REPAIR_RUN_COUNT;
+	}
+	if ((options->trace_filename || options->checkpoint_filename || options->resume_filename)
+		&& (options->restart_count > 0 || options->replica_count > 0)) {
+		fprintf(stderr, "options --trace, --checkpoint and --resume cannot be combined with --restarts or --replicas!\n");
+		exit(-1);
+	}
+	if (options->replica_count == 0 && options->temperature_count != 0) {
+		fprintf(stderr, "option --temperatures needs --replicas!\n");
+		exit(-1);
+	}
+	if (options->replica_count == 0 && options->restart_count == 0 && options->thread_count != 0) {
+		fprintf(stderr, "option --threads needs --restarts or --replicas!\n");
+		exit(-1);
+	}
+	if (options->restart_count > 0) {
+		if (options->thread_count == 0) {
+			options->thread_count = 1;
+		}
+		if (options->thread_count > options->restart_count) {
+			options->thread_count = options->restart_count;
+		}
+	}
+	if (options->replica_count > 0 && (options->thread_count == 0 || options->thread_count > options->replica_count)) {
+		options->thread_count = options->replica_count;
+	}
+
+	// fill in a geometric temperature ladder unless given one per replica
+	if (options->replica_count > 0 && options->temperature_count != options->replica_count) {
+		float min_temperature = DEFAULT_MIN_TEMPERATURE;
+		float max_temperature = DEFAULT_MAX_TEMPERATURE;
+		if (options->temperature_count == 2) {
+			min_temperature = options->temperatures[0];
+			max_temperature = options->temperatures[1];
+		} else if (options->temperature_count != 0) {
+			fprintf(stderr, "expected 2 or %d temperatures!\n", options->replica_count);
+			exit(-1);
+		}
+		int const last = options->replica_count - 1;
+		for (int i = 0; i <= last; ++i) {
+			float const t = (last > 0) ? ((float)i/(float)last) : 0.f;
+			options->temperatures[i] = min_temperature*powf(max_temperature/min_temperature, t);
+		}
+		options->temperature_count = options->replica_count;
+	}
+	for (int i = 1; i < options->temperature_count; ++i) {
+		if (options->temperatures[i] < options->temperatures[i - 1]) {
+			fprintf(stderr, "temperatures must be in increasing order!\n");
+			exit(-1);
+		}
+	}
+}
+
+void randomize_rota(config_t const *config, rng_t *rng, rota_t *rota)
+{
+	for (int i = 0; i < config->week_count; ++i) {
+		week_t *const week = &rota->weeks[i];
+		for (int j = 0; j < SHIFT_COUNT; ++j) {
+			week->shifts[j] = rota_rand(rng, config->person_count);
+		}
+	}
+}
+
+/*
+	Constructive start.
+
+	Instead of a random rota, the search can start from one built a shift at
+	a time, week by week with the ward week first since it clashes with the
+	most.  Each shift goes to someone eligible for it who does not clash
+	with a shift already filled, chosen at random from those within a
+	little of the furthest below their target for that kind of shift.  When
+	nobody fits, the shifts just filled are undone and given their next
+	choice, within a depth and an overall budget, after which the shift
+	goes to someone who fits the fewest constraints broken.  Shifts kept
+	from a previous rota or fixed by the input are filled in first.
+*/
 
-static char const *const g_category_names[CATEGORY_COUNT] =
+#define CONSTRUCT_MAX_BACKTRACK_DEPTH	8
+#define CONSTRUCT_MAX_BACKTRACKS		4096
+#define CONSTRUCT_TARGET_SLACK			.5f
+
+typedef enum
 {
-	NAME_HOLIDAY,
-	NAME_CANNOT_ON_CALL_DAY,
-	"always " NAME_CANNOT_ON_CALL_DAY,
-	NAME_CANNOT_WARD_WEEK,
-	NAME_DISLIKE_ON_CALL_DAY,
-	"always " NAME_DISLIKE_ON_CALL_DAY,
-	NAME_DISLIKE_WARD_WEEK,
-	NAME_PART_TIME,
-	NAME_START_DATE,
-	NAME_END_DATE,
-	NAME_BANK_HOLIDAY,
-	NAME_BANK_HOLIDAY_BIAS,
-	NAME_WARD_WEEK_BIAS,
-	NAME_ON_CALL_DAY_BIAS,
-	NAME_ON_CALL_WEEKEND_BIAS,
-	NAME_NO_WARD_WEEKS,
-	NAME_FORCE_ON_CALL_DAY
-};
+	SHIFT_KIND_ON_CALL_DAY,
+	SHIFT_KIND_ON_CALL_WEEKEND,
+	SHIFT_KIND_WARD_WEEK,
+
+	SHIFT_KIND_COUNT
+} shift_kind_t;
+
+typedef struct
+{
+	config_t const *config;
+	points_t const *points;
+	int *assigned;
+	int *totals;
+} construct_t;
+
+shift_kind_t get_shift_kind(int shift)
+{
+	switch (shift) {
+		case SHIFT_ON_CALL_WEEKEND:	return SHIFT_KIND_ON_CALL_WEEKEND;
+		case SHIFT_WARD_WEEK:		return SHIFT_KIND_WARD_WEEK;
+		default:					return SHIFT_KIND_ON_CALL_DAY;
+	}
+}
+
+float get_shift_deficit(construct_t const *construct, int person, shift_kind_t kind)
+{
+	person_config_t const *const person_config = &construct->config->people[person];
+	float const total = (float)construct->totals[person*SHIFT_KIND_COUNT + kind];
+	switch (kind) {
+		case SHIFT_KIND_ON_CALL_WEEKEND:
+			return person_config->target_on_call_weekends - person_config->on_call_weekend_bias - total;
+		case SHIFT_KIND_WARD_WEEK:
+			return person_config->target_ward_weeks - person_config->ward_week_bias - total;
+		default:
+			return person_config->target_on_call_days - person_config->on_call_day_bias - total;
+	}
+}
+
+void construct_assign(construct_t *construct, int slot, int person)
+{
+	int const old_person = construct->assigned[slot];
+	shift_kind_t const kind = get_shift_kind(slot % SHIFT_COUNT);
+	if (old_person != -1) {
+		--construct->totals[old_person*SHIFT_KIND_COUNT + kind];
+	}
+	if (person != -1) {
+		++construct->totals[person*SHIFT_KIND_COUNT + kind];
+	}
+	construct->assigned[slot] = person;
+}
+
+bool is_clash_free(construct_t const *construct, int slot, int person)
+{
+	int slots[MAX_CLASHING_SLOTS];
+	int const slot_count = get_clashing_slots(construct->config, slot, slots);
+	for (int i = 0; i < slot_count; ++i) {
+		if (construct->assigned[slots[i]] == person) {
+			return false;
+		}
+	}
+	return true;
+}
+
+int choose_constructive_person(
+	construct_t const *construct,
+	rng_t *rng,
+	int slot,
+	uint64_t const *tried,
+	bool must_fit)
+{
+	// eligible people that have not been tried here, or anyone if nobody is eligible
+	config_t const *const config = construct->config;
+	points_t const *const points = construct->points;
+	uint64_t const *const eligible = &points->eligible_people[slot*points->eligible_word_count];
+	bool const has_eligible = (points->eligible_counts[slot] > 0);
+	shift_kind_t const kind = get_shift_kind(slot % SHIFT_COUNT);
+	float best_deficit = 0.f;
+	int candidate_count = 0;
+	int chosen = -1;
+	for (int pass = 0; pass < 2; ++pass) {
+		for (int person = 0; person < config->person_count; ++person) {
+			uint64_t const bit = 1ULL << (person % 64);
+			if ((has_eligible && (eligible[person/64] & bit) == 0)
+				|| (tried && (tried[person/64] & bit) != 0)
+				|| (must_fit && !is_clash_free(construct, slot, person))) {
+				continue;
+			}
+			float const deficit = get_shift_deficit(construct, person, kind);
+			if (pass == 0) {
+				if (candidate_count++ == 0 || deficit > best_deficit) {
+					best_deficit = deficit;
+				}
+			} else if (deficit >= best_deficit - CONSTRUCT_TARGET_SLACK && rota_rand(rng, ++candidate_count) == 0) {
+				chosen = person;
+			}
+		}
+		if (candidate_count == 0) {
+			return -1;
+		}
+		candidate_count = 0;
+	}
+	return chosen;
+}
+
+void construct_rota(config_t const *config, points_t const *points, rng_t *rng, rota_t *rota)
+{
+	int const person_count = config->person_count;
+	int const slot_count = config->week_count*SHIFT_COUNT;
+	int const word_count = points->eligible_word_count;
+	construct_t construct;
+	construct.config = config;
+	construct.points = points;
+	construct.assigned = (int *)malloc(slot_count*sizeof(int));
+	construct.totals = (int *)calloc(person_count*SHIFT_KIND_COUNT, sizeof(int));
+	int *const order = (int *)malloc(slot_count*sizeof(int));
+	uint64_t *const tried = (uint64_t *)calloc(slot_count*word_count, sizeof(uint64_t));
+
+	// kept and fixed shifts first, then the rest in order
+	int order_count = 0;
+	for (int slot = 0; slot < slot_count; ++slot) {
+		construct.assigned[slot] = -1;
+		int person = config->fixed_shifts[slot];
+		if (person == -1 && config->previous_shifts) {
+			person = config->previous_shifts[slot];
+		}
+		construct_assign(&construct, slot, person);
+	}
+	for (int week_index = 0; week_index < config->week_count; ++week_index) {
+		int const first_slot = week_index*SHIFT_COUNT;
+		if (construct.assigned[first_slot + SHIFT_WARD_WEEK] == -1) {
+			order[order_count++] = first_slot + SHIFT_WARD_WEEK;
+		}
+		for (int shift = 0; shift < SHIFT_WARD_WEEK; ++shift) {
+			if (construct.assigned[first_slot + shift] == -1) {
+				order[order_count++] = first_slot + shift;
+			}
+		}
+	}
+
+	// fill with bounded backtracking
+	int backtrack_count = 0;
+	int dead_end = -1;
+	for (int i = 0; i < order_count;) {
+		int const slot = order[i];
+		uint64_t *const slot_tried = &tried[i*word_count];
+		int person = choose_constructive_person(&construct, rng, slot, slot_tried, true);
+		if (person == -1) {
+			if (dead_end == -1) {
+				dead_end = i;
+			}
+			if (i > 0 && dead_end - i < CONSTRUCT_MAX_BACKTRACK_DEPTH && backtrack_count < CONSTRUCT_MAX_BACKTRACKS) {
+				memset(slot_tried, 0, word_count*sizeof(uint64_t));
+				--i;
+				construct_assign(&construct, order[i], -1);
+				++backtrack_count;
+				continue;
+			}
+
+			// give up on fitting everything here
+			person = choose_constructive_person(&construct, rng, slot, NULL, true);
+			if (person == -1) {
+				person = choose_constructive_person(&construct, rng, slot, NULL, false);
+			}
+			dead_end = -1;
+		}
+		construct_assign(&construct, slot, person);
+		slot_tried[person/64] |= 1ULL << (person % 64);
+		if (++i > dead_end) {
+			dead_end = -1;
+		}
+	}
+
+	for (int slot = 0; slot < slot_count; ++slot) {
+		rota->weeks[slot/SHIFT_COUNT].shifts[slot % SHIFT_COUNT] = construct.assigned[slot];
+	}
+	free(tried);
+	free(order);
+	free(construct.totals);
+	free(construct.assigned);
+}
+
+void init_rota(config_t const *config, points_t const *points, init_t init, rng_t *rng, rota_t *rota)
+{
+	if (init == INIT_CONSTRUCTIVE) {
+		construct_rota(config, points, rng, rota);
+		return;
+	}
+
+	// random, apart from any shifts kept from a previous rota or fixed by the input
+	randomize_rota(config, rng, rota);
+	for (int i = 0; i < config->week_count; ++i) {
+		week_t *const week = &rota->weeks[i];
+		for (int j = 0; j < SHIFT_COUNT; ++j) {
+			int const previous_person = config->previous_shifts ? config->previous_shifts[i*SHIFT_COUNT + j] : -1;
+			if (previous_person != -1) {
+				week->shifts[j] = previous_person;
+			}
+			int const fixed_person = config->fixed_shifts[i*SHIFT_COUNT + j];
+			if (fixed_person != -1) {
+				week->shifts[j] = fixed_person;
+			}
+		}
+	}
+}
+
+move_t apply_move(config_t const *config, rng_t *rng, delta_t *delta, move_t move, int batch_size)
+{
+	switch (move) {
+		case MOVE_REPAIR:
+			if (mutate_repair(config, rng, delta)) {
+				return MOVE_REPAIR;
+			}
+			// no failures in the weeks that can change
+			mutate_random_reassign(config, rng, delta);
+			return MOVE_REASSIGN;
+
+		case MOVE_BATCHED_REASSIGN:
+			mutate_batched_reassign(config, rng, delta, batch_size);
+			break;
+
+		case MOVE_SWAP:
+			mutate_random_swap(config, rng, delta);
+			break;
+
+		case MOVE_WEEK_SWAP:
+			mutate_week_swap(config, rng, delta);
+			break;
+
+		case MOVE_PERSON_SWAP:
+			mutate_person_swap(config, rng, delta);
+			break;
+
+		case MOVE_WARD_WEEKEND_SWAP:
+			mutate_ward_weekend_swap(config, rng, delta);
+			break;
+
+		case MOVE_CHAIN_SWAP:
+			mutate_chain_swap(config, rng, delta);
+			break;
+
+		default:
+			mutate_random_reassign(config, rng, delta);
+			break;
+	}
+	return move;
+}
+
+/*
+	Adaptive move selection.
+
+	Which moves pay off changes as the search goes: repairs and compound
+	moves while the rota is still broken, cheap single shift moves while
+	polishing it.  Each move type is an arm of a bandit that is rewarded for
+	accepted improvements per unit of work, counted as the weeks the move
+	read while rescoring rather than timed, so a move that rescans long
+	chains pays for it and runs stay repeatable for a seed.  At the end of
+	each window of moves the rewards update a recency weighted quality for
+	each arm, and the arms are then picked in proportion to their quality,
+	with a floor so none is ever ruled out.
+	Repairs are only picked while the rota breaks hard constraints.
+*/
+
+#define SELECTOR_WINDOW_LENGTH		1024
+#define SELECTOR_LEARNING_RATE		.3f
+#define SELECTOR_MIN_PROBABILITY	.02f
+
+typedef struct
+{
+	bool is_available[MOVE_COUNT];
+	float qualities[MOVE_COUNT];
+	float probabilities[MOVE_COUNT];
+	int32_t window_rewards[MOVE_COUNT];
+	int64_t window_costs[MOVE_COUNT];
+	int32_t window_length;
+	int64_t use_counts[MOVE_COUNT];
+} selector_t;
+
+void update_selector_probabilities(selector_t *selector)
+{
+	int available_count = 0;
+	float quality_sum = 0.f;
+	for (int i = 0; i < MOVE_COUNT; ++i) {
+		if (selector->is_available[i]) {
+			++available_count;
+			quality_sum += selector->qualities[i];
+		}
+	}
+	float const spare = 1.f - (float)available_count*SELECTOR_MIN_PROBABILITY;
+	for (int i = 0; i < MOVE_COUNT; ++i) {
+		float probability = 0.f;
+		if (selector->is_available[i]) {
+			float const share = (quality_sum > 0.f) ? selector->qualities[i]/quality_sum : 1.f/(float)available_count;
+			probability = SELECTOR_MIN_PROBABILITY + spare*share;
+		}
+		selector->probabilities[i] = probability;
+	}
+}
+
+void init_selector(selector_t *selector, int batch_size)
+{
+	memset(selector, 0, sizeof(selector_t));
+	for (int i = 0; i < MOVE_COUNT; ++i) {
+		selector->is_available[i] = true;
+	}
+	if (batch_size <= 1) {
+		selector->is_available[MOVE_BATCHED_REASSIGN] = false;
+	}
+	update_selector_probabilities(selector);
+}
+
+move_t select_move(selector_t const *selector, rng_t *rng, delta_t const *delta)
+{
+	// repairs only make sense while there are failures
+	bool const can_repair = (delta->failure_count != 0);
+	float total = 1.f;
+	if (!can_repair) {
+		total -= selector->probabilities[MOVE_REPAIR];
+	}
+	float x = rota_rand_float(rng)*total;
+	move_t move = MOVE_REASSIGN;
+	for (int i = 0; i < MOVE_COUNT; ++i) {
+		if (selector->is_available[i] && (can_repair || i != MOVE_REPAIR)) {
+			move = (move_t)i;
+			x -= selector->probabilities[i];
+			if (x < 0.f) {
+				break;
+			}
+		}
+	}
+	return move;
+}
+
+void update_selector(selector_t *selector, delta_t const *delta, move_t move, bool is_improvement)
+{
+	// a move that did nothing still cost something to pick
+	++selector->use_counts[move];
+	selector->window_rewards[move] += is_improvement;
+	selector->window_costs[move] += MAX(delta->week_reads, 1);
+	if (++selector->window_length < SELECTOR_WINDOW_LENGTH) {
+		return;
+	}
+
+	// fold the window into the qualities, moves that were not used (such as
+	// repairs once the rota is valid) earn nothing
+	for (int i = 0; i < MOVE_COUNT; ++i) {
+		float const reward = (selector->window_costs[i] > 0) ? (float)selector->window_rewards[i]/(float)selector->window_costs[i] : 0.f;
+		selector->qualities[i] += SELECTOR_LEARNING_RATE*(reward - selector->qualities[i]);
+		selector->window_rewards[i] = 0;
+		selector->window_costs[i] = 0;
+	}
+	selector->window_length = 0;
+	update_selector_probabilities(selector);
+}
+
+void add_move_mix(move_mix_t *mix, selector_t const *selector)
+{
+	++mix->chain_count;
+	for (int i = 0; i < MOVE_COUNT; ++i) {
+		mix->probabilities[i] += selector->probabilities[i];
+		mix->use_counts[i] += selector->use_counts[i];
+	}
+}
+
+void merge_move_mix(move_mix_t *mix, move_mix_t const *other)
+{
+	mix->chain_count += other->chain_count;
+	for (int i = 0; i < MOVE_COUNT; ++i) {
+		mix->probabilities[i] += other->probabilities[i];
+		mix->use_counts[i] += other->use_counts[i];
+	}
+}
+
+void print_move_mix(move_mix_t const *mix)
+{
+	int64_t total_use_count = 0;
+	for (int i = 0; i < MOVE_COUNT; ++i) {
+		total_use_count += mix->use_counts[i];
+	}
+	if (mix->chain_count == 0 || total_use_count == 0) {
+		return;
+	}
+	printf("move mix (learned by the end, used over the run):\n");
+	for (int i = 0; i < MOVE_COUNT; ++i) {
+		if (mix->probabilities[i] > 0.0 || mix->use_counts[i] > 0) {
+			printf("  %-18s %5.1f%% %5.1f%%\n",
+				g_move_names[i],
+				100.0*mix->probabilities[i]/(double)mix->chain_count,
+				100.0*(double)mix->use_counts[i]/(double)total_use_count);
+		}
+	}
+}
+
+move_t mutate_random(
+	config_t const *config,
+	rng_t *rng,
+	delta_t *delta,
+	int batch_size,
+	float repair_rate,
+	selector_t const *selector)
+{
+	// nothing to change if the input decides every shift
+	delta->week_reads = 0;
+	if (config->free_slot_count == 0) {
+		return MOVE_REASSIGN;
+	}
+
+	STATS_BEGIN(move);
+	move_t move;
+	if (selector) {
+		move = select_move(selector, rng, delta);
+	} else {
+		// fixed mix of moves
+		if (delta->failure_count != 0 && repair_rate > 0.f && rota_rand_float(rng) < repair_rate && mutate_repair(config, rng, delta)) {
+			STATS_END(move, SECTION_MOVE);
+			return MOVE_REPAIR;
+		}
+		if (rota_rand(rng, COMPOUND_MOVE_ODDS) == 0) {
+			move = (move_t)(MOVE_WEEK_SWAP + rota_rand(rng, MOVE_COUNT - MOVE_WEEK_SWAP));
+		} else if (rota_rand(rng, 2) == 0) {
+			move = (batch_size > 1) ? MOVE_BATCHED_REASSIGN : MOVE_REASSIGN;
+		} else {
+			move = MOVE_SWAP;
+		}
+	}
+	move = apply_move(config, rng, delta, move, batch_size);
+	STATS_END(move, SECTION_MOVE);
+	return move;
+}
+
+/*
+	Metropolis acceptance.
+
+	Rather than computing exp(change/T) for each worse candidate, the test
+	is done as change > T*ln(u) with ln(u) looked up from a table of
+	quantised uniform samples, so it costs a single multiply.
+*/
+
+#define ACCEPT_LOG_TABLE_BITS		12
+#define ACCEPT_LOG_TABLE_SIZE		(1 << ACCEPT_LOG_TABLE_BITS)
+
+static float g_accept_log_table[ACCEPT_LOG_TABLE_SIZE];
+
+void init_accept_log_table(void)
+{
+	for (int i = 0; i < ACCEPT_LOG_TABLE_SIZE; ++i) {
+		g_accept_log_table[i] = logf(((float)i + .5f)/(float)ACCEPT_LOG_TABLE_SIZE);
+	}
+}
+
+bool accept_change(rng_t *rng, float value_change, float temperature)
+{
+	if (value_change >= 0.f) {
+		return true;
+	}
+	return value_change > temperature*g_accept_log_table[rng_next(rng) >> (64 - ACCEPT_LOG_TABLE_BITS)];
+}
+
+int compare_floats_ascending(void const *a, void const *b)
+{
+	float const x = *(float const *)a;
+	float const y = *(float const *)b;
+	return (x > y) - (x < y);
+}
+
+void calibrate_temperatures(
+	config_t const *config,
+	rng_t *rng,
+	delta_t *delta,
+	int batch_size,
+	float initial_acceptance,
+	float *initial_temperature,
+	float *final_temperature)
+{
+	// sample the size of worse moves from the starting rota, and separately
+	// those that break no more hard constraints
+	float worse_changes[ANNEAL_CALIBRATION_COUNT];
+	float soft_changes[ANNEAL_CALIBRATION_COUNT];
+	int worse_count = 0;
+	int soft_count = 0;
+	for (int i = 0; i < ANNEAL_CALIBRATION_COUNT; ++i) {
+		double const current_value = delta->value;
+		int const current_failure_count = delta->failure_count;
+		mutate_random(config, rng, delta, batch_size, 0.f, NULL);
+		float const value_change = (float)(delta->value - current_value);
+		bool const is_soft = (delta->failure_count <= current_failure_count);
+		delta_rollback(delta);
+		if (value_change < 0.f) {
+			worse_changes[worse_count++] = -value_change;
+			if (is_soft) {
+				soft_changes[soft_count++] = -value_change;
+			}
+		}
+	}
+	if (worse_count == 0) {
+		*initial_temperature = 1.f;
+		*final_temperature = ANNEAL_MAX_FINAL_RATIO;
+		return;
+	}
+
+	// start where the sampled worse moves are accepted at the given rate on
+	// average, found by bisection since hard constraints skew the mean
+	qsort(worse_changes, worse_count, sizeof(float), compare_floats_ascending);
+	float low = worse_changes[0];
+	float high = 10.f*worse_changes[worse_count - 1];
+	for (int iteration = 0; iteration < 32; ++iteration) {
+		float const temperature = sqrtf(low*high);
+		double acceptance = 0.0;
+		for (int i = 0; i < worse_count; ++i) {
+			acceptance += expf(-worse_changes[i]/temperature);
+		}
+		if (acceptance < initial_acceptance*(double)worse_count) {
+			low = temperature;
+		} else {
+			high = temperature;
+		}
+	}
+	*initial_temperature = sqrtf(low*high);
+
+	// finish where the smaller worse soft moves are rarely accepted, and
+	// always well below the start so the schedule really cools
+	float const *const final_changes = (soft_count > 0) ? soft_changes : worse_changes;
+	int const final_count = (soft_count > 0) ? soft_count : worse_count;
+	qsort(soft_changes, soft_count, sizeof(float), compare_floats_ascending);
+	*final_temperature = MIN(final_changes[final_count/10]/-logf(ANNEAL_FINAL_ACCEPTANCE), ANNEAL_MAX_FINAL_RATIO*(*initial_temperature));
+}
+
+/*
+	Convergence trace.
+
+	Samples of the search are written as CSV lines through a large stdio
+	buffer, so that tracing only costs a formatted print every sample and
+	an occasional write to the file.
+*/
+
+typedef struct
+{
+	FILE *fp;
+	char *buffer;
+	int interval;
+	int accept_count;
+} trace_t;
+
+trace_t *open_trace(char const *filename, int interval)
+{
+	trace_t *const trace = (trace_t *)malloc(sizeof(trace_t));
+	trace->fp = fopen(filename, "w");
+	if (!trace->fp) {
+		fprintf(stderr, "failed to open \"%s\" for writing!\n", filename);
+		exit(-1);
+	}
+	trace->buffer = (char *)malloc(TRACE_BUFFER_SIZE);
+	setvbuf(trace->fp, trace->buffer, _IOFBF, TRACE_BUFFER_SIZE);
+	trace->interval = interval;
+	trace->accept_count = 0;
+	fprintf(trace->fp, "iteration,seconds,score,best_score,failure_count,acceptance_rate,temperature\n");
+	return trace;
+}
+
+void write_trace(
+	trace_t *trace,
+	int64_t iteration_count,
+	double seconds,
+	double value,
+	double best_value,
+	int failure_count,
+	int window_length,
+	float temperature)
+{
+	fprintf(trace->fp, "%lld,%.4f,%f,%f,%d,%.4f,",
+		(long long)iteration_count,
+		seconds,
+		value,
+		best_value,
+		failure_count,
+		(float)trace->accept_count/(float)MAX(window_length, 1));
+	if (temperature > 0.f) {
+		fprintf(trace->fp, "%g\n", temperature);
+	} else {
+		fprintf(trace->fp, "\n");
+	}
+	trace->accept_count = 0;
+}
+
+void close_trace(trace_t *trace)
+{
+	fclose(trace->fp);
+	free(trace->buffer);
+	free(trace);
+}
+
+/*
+	Checkpoints.
+
+	A single chain can save everything it needs to carry on: the current
+	and best rotas, the delta tracker (whose running totals are not exactly
+	what a fresh delta_init would compute), the random number generator and
+	the loop counters.  Checkpoints are taken between annealing steps when
+	the journal is empty, so resuming continues bit for bit, unless a time
+	limit is steering the schedule.  Each checkpoint is written to a
+	temporary file then renamed over the previous one, so a run killed
+	part way through a write leaves the last checkpoint intact.
+*/
+
+#define CHECKPOINT_MAGIC		"ROTACKPT"
+#define CHECKPOINT_VERSION		6
+#define HASH_OFFSET_BASIS		14695981039346656037ULL
+#define HASH_PRIME				1099511628211ULL
+
+typedef struct
+{
+	char magic[8];
+	uint32_t version;
+
+	// must match the resuming run
+	int32_t person_count;
+	int32_t week_count;
+	uint64_t input_hash;
+	uint64_t options_hash;
+
+	// chain state
+	rng_t rng;
+	selector_t selector;
+	int64_t next_iteration;
+	int64_t iteration_count;
+	int64_t last_improvement;
+	int32_t last_percent;
+	int64_t first_valid_iteration;
+	double first_valid_seconds;
+	double elapsed_seconds;
+	double best_value;
+	double value;
+	int32_t failure_count;
+	int32_t failing_week_count;
+	float initial_temperature;
+	float final_temperature;
+} checkpoint_t;
+
+uint64_t hash_bytes(uint64_t hash, void const *data, size_t size)
+{
+	// 64 bit FNV-1a
+	uint8_t const *const bytes = (uint8_t const *)data;
+	for (size_t i = 0; i < size; ++i) {
+		hash = (hash ^ bytes[i])*HASH_PRIME;
+	}
+	return hash;
+}
+
+uint64_t hash_file(uint64_t hash, char const *filename)
+{
+	FILE *const fp = fopen(filename, "rb");
+	if (!fp) {
+		fprintf(stderr, "failed to open \"%s\"!\n", filename);
+		exit(-1);
+	}
+	uint8_t buffer[4096];
+	size_t size;
+	while ((size = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+		hash = hash_bytes(hash, buffer, size);
+	}
+	fclose(fp);
+	return hash;
+}
+
+uint64_t hash_search_options(options_t const *options)
+{
+	// everything that steers a single chain, field by field to skip padding
+	uint64_t hash = HASH_OFFSET_BASIS;
+	int const has_from = (options->from_filename != NULL);
+	int const has_target_score = options->has_target_score;
+	int const schedule = options->schedule;
+	int const move_selection = options->move_selection;
+	int const init = options->init;
+	hash = hash_bytes(hash, &options->seed, sizeof(options->seed));
+	hash = hash_bytes(hash, &schedule, sizeof(schedule));
+	hash = hash_bytes(hash, &options->max_iterations, sizeof(options->max_iterations));
+	hash = hash_bytes(hash, &options->time_limit, sizeof(options->time_limit));
+	hash = hash_bytes(hash, &options->stall_iterations, sizeof(options->stall_iterations));
+	hash = hash_bytes(hash, &has_target_score, sizeof(has_target_score));
+	hash = hash_bytes(hash, &options->target_score, sizeof(options->target_score));
+	hash = hash_bytes(hash, &options->batch_size, sizeof(options->batch_size));
+	hash = hash_bytes(hash, &options->repair_rate, sizeof(options->repair_rate));
+	hash = hash_bytes(hash, &move_selection, sizeof(move_selection));
+	hash = hash_bytes(hash, &init, sizeof(init));
+	hash = hash_bytes(hash, &has_from, sizeof(has_from));
+	hash = hash_bytes(hash, &options->from_window, sizeof(options->from_window));
+	return hash;
+}
+
+void init_checkpoint(checkpoint_t *checkpoint, config_t const *config, options_t const *options)
+{
+	memset(checkpoint, 0, sizeof(checkpoint_t));
+	memcpy(checkpoint->magic, CHECKPOINT_MAGIC, sizeof(checkpoint->magic));
+	checkpoint->version = CHECKPOINT_VERSION;
+	checkpoint->person_count = config->person_count;
+	checkpoint->week_count = config->week_count;
+	checkpoint->input_hash = config->input_hash;
+	checkpoint->options_hash = hash_search_options(options);
+}
+
+void write_checkpoint(
+	char const *filename,
+	config_t const *config,
+	checkpoint_t const *checkpoint,
+	rota_t const *current,
+	rota_t const *best_rota,
+	delta_t const *delta)
+{
+	char temp_filename[1024];
+	snprintf(temp_filename, sizeof(temp_filename), "%s.tmp", filename);
+	FILE *const fp = fopen(temp_filename, "wb");
+	if (!fp) {
+		fprintf(stderr, "failed to open \"%s\" for writing!\n", temp_filename);
+		exit(-1);
+	}
+	size_t const rota_size = config->week_count*sizeof(week_t);
+	bool const is_written = fwrite(checkpoint, sizeof(checkpoint_t), 1, fp) == 1
+		&& fwrite(current->weeks, rota_size, 1, fp) == 1
+		&& fwrite(best_rota->weeks, rota_size, 1, fp) == 1
+		&& fwrite(delta + 1, get_delta_arrays_size(config), 1, fp) == 1;
+	if (fclose(fp) != 0 || !is_written) {
+		fprintf(stderr, "failed to write checkpoint \"%s\"!\n", temp_filename);
+		exit(-1);
+	}
+#ifdef _WIN32
+	bool const is_renamed = MoveFileExA(temp_filename, filename, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	bool const is_renamed = rename(temp_filename, filename) == 0;
+#endif
+	if (!is_renamed) {
+		fprintf(stderr, "failed to rename checkpoint to \"%s\"!\n", filename);
+		exit(-1);
+	}
+}
 
-int match_category_by_tag(char const *tag)
+void read_checkpoint(
+	char const *filename,
+	config_t const *config,
+	options_t const *options,
+	checkpoint_t *checkpoint,
+	rota_t *current,
+	rota_t *best_rota,
+	delta_t *delta)
 {
-	for (int i = 0; i < CATEGORY_COUNT; ++i) {
-		if (strcmp(tag, g_category_names[i]) == 0) {
-			return i;
-		}
+	FILE *const fp = fopen(filename, "rb");
+	if (!fp) {
+		fprintf(stderr, "failed to open checkpoint \"%s\"!\n", filename);
+		exit(-1);
 	}
-	fprintf(stderr, "unknown category \"%s\"!\n", tag);
-	exit(-1);
-	return -1;
+	checkpoint_t expected;
+	init_checkpoint(&expected, config, options);
+	if (fread(checkpoint, sizeof(checkpoint_t), 1, fp) != 1
+		|| memcmp(checkpoint->magic, expected.magic, sizeof(expected.magic)) != 0
+		|| checkpoint->version != expected.version) {
+		fprintf(stderr, "\"%s\" is not a checkpoint!\n", filename);
+		exit(-1);
+	}
+	if (checkpoint->person_count != expected.person_count
+		|| checkpoint->week_count != expected.week_count
+		|| checkpoint->input_hash != expected.input_hash) {
+		fprintf(stderr, "checkpoint \"%s\" was saved for a different input, points or previous rota!\n", filename);
+		exit(-1);
+	}
+	if (checkpoint->options_hash != expected.options_hash) {
+		fprintf(stderr, "checkpoint \"%s\" was saved with different search options!\n", filename);
+		exit(-1);
+	}
+	size_t const rota_size = config->week_count*sizeof(week_t);
+	if (fread(current->weeks, rota_size, 1, fp) != 1
+		|| fread(best_rota->weeks, rota_size, 1, fp) != 1
+		|| fread(delta + 1, get_delta_arrays_size(config), 1, fp) != 1) {
+		fprintf(stderr, "checkpoint \"%s\" is truncated!\n", filename);
+		exit(-1);
+	}
+	fclose(fp);
+	delta->value = checkpoint->value;
+	delta->failure_count = checkpoint->failure_count;
+	delta->failing_week_count = checkpoint->failing_week_count;
 }
 
-#define FIRST_DAY_COLUMN		2
+bool is_target_reached(options_t const *options, double value, int failure_count)
+{
+	return options->has_target_score && failure_count == 0 && value >= options->target_score;
+}
 
-char *rota_get_line(char *line_buf, int max_length, FILE *fp)
+void run_single_chain(
+	config_t const *config,
+	points_t const *points,
+	options_t const *options,
+	rng_t *rng,
+	rota_t *best_rota,
+	bool show_progress,
+	run_stats_t *stats)
 {
-	int const last = max_length - 1;
-	int i = 0;
-	do {
-		int const c = fgetc(fp);
-		if (c == EOF) {
-			if (i == 0) {
-				return NULL;
+	rota_t *const current = alloc_rota(config);
+	delta_t *const delta = alloc_delta(config);
+
+	// geometric cooling between calibrated temperatures, over the iterations
+	// or the time limit, whichever is further along
+	bool const has_iteration_limit = (options->max_iterations > 0);
+	int64_t const run_count = has_iteration_limit ? options->max_iterations : INT64_MAX;
+	int const acceptance_half_life = 256*1024;
+	float initial_temperature = 0.f;
+	float final_temperature = 0.f;
+	float temperature = 0.f;
+
+	stop_reason_t stop_reason = STOP_MAX_ITERATIONS;
+	int64_t start_iteration = 0;
+	int64_t iteration_count = 0;
+	int64_t first_valid_iteration = -1;
+	double first_valid_seconds = 0.0;
+	double start_time = get_seconds();
+	int last_percent = 0;
+	int64_t last_improvement = 0;
+	double best_value;
+	selector_t selector;
+	init_selector(&selector, options->batch_size);
+	selector_t *const active_selector = (options->move_selection == MOVES_ADAPTIVE) ? &selector : NULL;
+	if (options->resume_filename) {
+		// carry on exactly where the checkpoint left off
+		checkpoint_t checkpoint;
+		delta_init(delta, config, points, current);
+		read_checkpoint(options->resume_filename, config, options, &checkpoint, current, best_rota, delta);
+		*rng = checkpoint.rng;
+		selector = checkpoint.selector;
+		start_iteration = checkpoint.next_iteration;
+		iteration_count = checkpoint.iteration_count;
+		first_valid_iteration = checkpoint.first_valid_iteration;
+		first_valid_seconds = checkpoint.first_valid_seconds;
+		start_time -= checkpoint.elapsed_seconds;
+		last_percent = checkpoint.last_percent;
+		last_improvement = checkpoint.last_improvement;
+		best_value = checkpoint.best_value;
+		initial_temperature = checkpoint.initial_temperature;
+		final_temperature = checkpoint.final_temperature;
+	} else {
+		// build or randomly assign a rota, starting cooler to keep a previous or built one
+		init_rota(config, points, options->init, rng, current);
+		delta_init(delta, config, points, current);
+		if (options->schedule == SCHEDULE_ANNEAL) {
+			bool const is_warm = (config->previous_shifts || options->init == INIT_CONSTRUCTIVE);
+			float const initial_acceptance = is_warm ? ANNEAL_WARM_INITIAL_ACCEPTANCE : ANNEAL_INITIAL_ACCEPTANCE;
+			calibrate_temperatures(config, rng, delta, options->batch_size, initial_acceptance, &initial_temperature, &final_temperature);
+			if (show_progress) {
+				printf("annealing from temperature %g to %g\n", initial_temperature, final_temperature);
 			}
-			break;
 		}
-		if (c == '\r' || c == '\n') {
-			break;
+		if (delta->failure_count == 0) {
+			first_valid_iteration = 0;
 		}
-		line_buf[i++] = (char)c;
-	} while(i < last);
-	line_buf[i] = '\0';
-	return line_buf;
-}
-
-void read_config(char const *filename, config_t *config)
-{
-	memset(config, 0, sizeof(config_t));
-	for (int i = 0; i < 7*MAX_WEEK_COUNT; ++i) {
-		config->forced_on_call_people[i] = -1;
+		best_value = delta->value;
+		copy_rota(best_rota, current);
 	}
 
-	FILE *const fp = fopen(filename, "r");
-	if (!fp) {
-		fprintf(stderr, "failed to open file \"%s\" for reading!\n", filename);
-		exit(-1);
-	}
+	// mutate to global optimum
+	trace_t *const trace = options->trace_filename ? open_trace(options->trace_filename, options->trace_interval) : NULL;
+	int64_t last_trace_iteration = iteration_count;
+	double last_checkpoint_time = get_seconds();
+	for (int64_t i = start_iteration; i < run_count; ++i) {
+		// every step, check the clock and cool by whichever budget is further along
+		if ((i % ANNEAL_STEP_LENGTH) == 0) {
+			// rescore from scratch now and then so rounding in the running totals
+			// cannot build up
+			if ((i % DELTA_RESYNC_INTERVAL) == 0) {
+				delta_init(delta, config, points, current);
+			}
+			if (options->checkpoint_filename && i != start_iteration && get_seconds() - last_checkpoint_time >= options->checkpoint_interval) {
+				checkpoint_t checkpoint;
+				init_checkpoint(&checkpoint, config, options);
+				checkpoint.rng = *rng;
+				checkpoint.selector = selector;
+				checkpoint.next_iteration = i;
+				checkpoint.iteration_count = iteration_count;
+				checkpoint.last_improvement = last_improvement;
+				checkpoint.last_percent = last_percent;
+				checkpoint.first_valid_iteration = first_valid_iteration;
+				checkpoint.first_valid_seconds = first_valid_seconds;
+				checkpoint.elapsed_seconds = get_seconds() - start_time;
+				checkpoint.best_value = best_value;
+				checkpoint.value = delta->value;
+				checkpoint.failure_count = delta->failure_count;
+				checkpoint.failing_week_count = delta->failing_week_count;
+				checkpoint.initial_temperature = initial_temperature;
+				checkpoint.final_temperature = final_temperature;
+				write_checkpoint(options->checkpoint_filename, config, &checkpoint, current, best_rota, delta);
+				last_checkpoint_time = get_seconds();
+			}
 
-	char *const line_buf = malloc(MAX_LINE_LENGTH);
+			float progress = has_iteration_limit ? (float)((double)i/(double)run_count) : 0.f;
+			if (options->time_limit > 0.0) {
+				double const elapsed = get_seconds() - start_time;
+				if (elapsed >= options->time_limit) {
+					stop_reason = STOP_TIME_LIMIT;
+					break;
+				}
+				progress = MAX(progress, (float)(elapsed/options->time_limit));
+			}
+			temperature = initial_temperature*powf(final_temperature/initial_temperature, progress);
+
+			// progress?
+			int const percent = (int)(100.f*progress);
+			if (show_progress && percent != last_percent) {
+				printf("\rworking: %d%% (%f/%f points)...          ", percent, best_value, delta->value);
+				fflush(stdout);
+				last_percent = percent;
+			}
+		}
+		++iteration_count;
 
-	// check first row headers and get date range
-	char *line = rota_get_line(line_buf, MAX_LINE_LENGTH, fp);
-	if (!line) {
-		fprintf(stderr, "failed to read first line of input file!\n");
-		exit(-1);
-	}
-	int day_count = 0;
-	for (int col = 0;; ++col) {
-		char *const next = scan_for_next_column(line);
-		if (!line || *line == '\0') {
-			day_count = col - FIRST_DAY_COLUMN;
-			if ((day_count % 7) != 0) {
-				fprintf(stderr, "rota must be a whole number of weeks!\n");
-				exit(-1);
+		// do mutation in place, keeping the journal to undo it
+		double const current_value = delta->value;
+		move_t const move = mutate_random(config, rng, delta, options->batch_size, options->repair_rate, active_selector);
+
+		// accept randomly or if better
+		STATS_BEGIN(accept);
+		bool accept;
+		if (options->schedule == SCHEDULE_ANNEAL) {
+			accept = accept_change(rng, (float)(delta->value - current_value), temperature);
+		} else {
+			float const accept_prob = powf(.5f, 1.f + (float)i/(float)acceptance_half_life);
+			accept = (delta->value > current_value || rota_rand_float(rng) < accept_prob);
+		}
+		STATS_RECORD_MOVE(move, accept, delta->value > current_value);
+		if (active_selector) {
+			update_selector(active_selector, delta, move, accept && delta->value > current_value);
+		}
+		if (accept) {
+			delta_commit(delta);
+		} else {
+			delta_rollback(delta);
+		}
+		STATS_END(accept, SECTION_ACCEPT);
+
+		// keep track of best ever
+		if (i == 0 || delta->value > best_value) {
+			copy_rota(best_rota, current);
+			best_value = delta->value;
+			last_improvement = i;
+			if (first_valid_iteration == -1 && delta->failure_count == 0) {
+				first_valid_iteration = iteration_count;
+				first_valid_seconds = get_seconds() - start_time;
 			}
-			config->week_count = day_count/7;
-			if (config->week_count > MAX_WEEK_COUNT) {
-				fprintf(stderr, "rota can be at most %d weeks!\n", MAX_WEEK_COUNT);
-				exit(-1);
+			if (is_target_reached(options, delta->value, delta->failure_count)) {
+				stop_reason = STOP_TARGET_SCORE;
+				break;
 			}
+		}
+		if (options->stall_iterations > 0 && i - last_improvement >= options->stall_iterations) {
+			stop_reason = STOP_STALL_ITERATIONS;
 			break;
 		}
-		if (col == FIRST_DAY_COLUMN) {
-			config->first_day = parse_date(line);
 
-			// check first day is the first day of the week
-			tm_t *t = localtime(&config->first_day);
-			if (!t || t->tm_wday != 1) {
-				fprintf(stderr, "first rota day must be a Monday!\n");
-				exit(-1);
+		// sample the search?
+		if (trace) {
+			trace->accept_count += accept;
+			if ((iteration_count % trace->interval) == 0) {
+				write_trace(trace, iteration_count, get_seconds() - start_time, delta->value, best_value, delta->failure_count, iteration_count - last_trace_iteration, temperature);
+				last_trace_iteration = iteration_count;
 			}
 		}
-		if (col > FIRST_DAY_COLUMN) {
-			time_t const t = parse_date(line);
-			if (t != config->first_day + (col - FIRST_DAY_COLUMN)*TIME_DELTA_DAY) {
-				fprintf(stderr, "column %d has unexpected day!\n", col);
-				exit(-1);
-			}
+	}
+	if (trace) {
+		if (iteration_count != last_trace_iteration) {
+			write_trace(trace, iteration_count, get_seconds() - start_time, delta->value, best_value, delta->failure_count, iteration_count - last_trace_iteration, temperature);
 		}
-		line = next;
+		close_trace(trace);
 	}
-	config->total_on_call_days_and_bias = 5*config->week_count;
-	config->total_on_call_weekends_and_bias = config->week_count;
-	config->total_ward_weeks_and_bias = config->week_count;
 
-	// handle each row
-	for (;;) {
-		line = rota_get_line(line_buf, MAX_LINE_LENGTH, fp);
-		if (!line) {
-			break;
-		}
-		int person = -1;
-		int category = -1;
-		for (int col = 0; col < FIRST_DAY_COLUMN + day_count && line; ++col) {
-			char *const next = scan_for_next_column(line);
-			if (col == 0) {
-				// skip rows with no person
-				if (line && *line != '\0') {
-					person = find_or_add_person(config, line);
-				}
-			} else if (col == 1) {
-				// only allow bank holidays with no person
-				if (!line || *line == '\0') {
-					if (person == -1) {
-						break;
-					}
-					fprintf(stderr, "expected category!\n");
-					exit(-1);
-				}
-				category = match_category_by_tag(line);
-				if (person == -1 && category != CATEGORY_BANK_HOLIDAY) {
-					break;
-				}
-			} else if (*line != '\0') {
-				int const rota_day_index = col - FIRST_DAY_COLUMN;
-				int const weekday_index = rota_day_index % 7;
-				float amount = 0.f;
-				switch (category) {
-					case CATEGORY_HOLIDAY:
-						set_holiday_day(config, rota_day_index, person);
-						break;
+	stats->stop_reason = stop_reason;
+	stats->iteration_count = iteration_count;
+	stats->seconds = get_seconds() - start_time;
+	stats->first_valid_iteration = first_valid_iteration;
+	stats->first_valid_seconds = first_valid_seconds;
+	memset(&stats->move_mix, 0, sizeof(move_mix_t));
+	if (active_selector) {
+		add_move_mix(&stats->move_mix, active_selector);
+	}
 
-					case CATEGORY_CANNOT_ON_CALL_DAY:
-						set_invalid_on_call_day(config, rota_day_index, person);
-						break;
+	free(delta);
+	free(current);
+}
 
-					case CATEGORY_CANNOT_ON_CALL_DAY_ALWAYS:
-						for (int week_index = 0; week_index < config->week_count; ++week_index) {
-							int const day_index_always = 7*week_index + weekday_index;
-							set_invalid_on_call_day(config, day_index_always, person);
-						}
-						break;
+/*
+	Restarts.
 
-					case CATEGORY_DISLIKE_ON_CALL_DAY:
-						set_disliked_on_call_day(config, rota_day_index, person);
-						break;
+	Each restart is an independent single chain with its own random stream,
+	split from the main one up front in restart order.  Worker threads take
+	the next restart from a shared counter, and the best rota is chosen by
+	score then by restart index, so the result does not depend on the
+	number of threads.
+*/
 
-					case CATEGORY_DISLIKE_ON_CALL_DAY_ALWAYS:
-						for (int week_index = 0; week_index < config->week_count; ++week_index) {
-							int const day_index_always = 7*week_index + weekday_index;
-							set_disliked_on_call_day(config, day_index_always, person);
-						}
-						break;
+typedef struct
+{
+	config_t const *config;
+	points_t const *points;
+	options_t const *options;
+	rng_t *rngs;
+	double *values;
+	int *failure_counts;
+	mutex_t mutex;
+	int next_restart_index;
+	int finished_count;
+	int stop_reason_counts[STOP_COUNT];
+	int64_t iteration_count;
+	move_mix_t move_mix;
+} restarts_t;
 
-					case CATEGORY_CANNOT_WARD_WEEK:
-						if (weekday_index < 5) {
-							set_invalid_ward_week(config, rota_day_index/7, person);
-						} else {
-							fprintf(stderr, "found cannot ward week on a weekend day, ignoring it!\n");
-						}
-						break;
+typedef struct
+{
+	restarts_t *restarts;
+	rota_t *best_rota;
+	double best_value;
+	int best_restart_index;
+} restarts_thread_t;
 
-					case CATEGORY_DISLIKE_WARD_WEEK:
-						if (weekday_index < 5) {
-							set_disliked_ward_week(config, rota_day_index/7, person);
-						} else {
-							fprintf(stderr, "found dislike of ward week on a weekend day, ignoring it!\n");
-						}
-						break;
+THREAD_FUNC(restarts_thread, arg)
+{
+	restarts_thread_t *const thread = (restarts_thread_t *)arg;
+	restarts_t *const restarts = thread->restarts;
+	config_t const *const config = restarts->config;
+	points_t const *const points = restarts->points;
+	options_t const *const options = restarts->options;
+	rota_t *const rota = alloc_rota(config);
+	score_t *const score = alloc_score(config);
+	thread->best_restart_index = -1;
+	for (;;) {
+		mutex_lock(&restarts->mutex);
+		int const restart_index = restarts->next_restart_index++;
+		mutex_unlock(&restarts->mutex);
+		if (restart_index >= options->restart_count) {
+			break;
+		}
 
-					case CATEGORY_PART_TIME:
-						if (sscanf(line, "%f", &amount) != 1) {
-							fprintf(stderr, "part time amount \"%s\" is not valid!\n", line);
-							exit(-1);
-						}
-						if (amount < 0.f || 1.f < amount) {
-							fprintf(stderr, "part time amount %f is not valid!\n", amount);
-							exit(-1);
-						}
-						config->people[person].full_time_amount = amount;
-						break;
+		// rescore from scratch so every restart is judged the same way
+		run_stats_t stats;
+		run_single_chain(config, points, options, &restarts->rngs[restart_index], rota, false, &stats);
+		score_rota(config, points, rota, score);
+		restarts->values[restart_index] = score->value;
+		restarts->failure_counts[restart_index] = score->failure_count;
+		if (thread->best_restart_index == -1 || score->value > thread->best_value) {
+			copy_rota(thread->best_rota, rota);
+			thread->best_value = score->value;
+			thread->best_restart_index = restart_index;
+		}
 
-					case CATEGORY_START_DATE:
-						if (config->people[person].first_day != 0) {
-							fprintf(stderr, "cannot set multiple start dates per person!\n");
-							exit(-1);
-						}
-						config->people[person].first_day = rota_day_index;
-						break;
+		mutex_lock(&restarts->mutex);
+		int const finished_count = ++restarts->finished_count;
+		++restarts->stop_reason_counts[stats.stop_reason];
+		restarts->iteration_count += stats.iteration_count;
+		merge_move_mix(&restarts->move_mix, &stats.move_mix);
+		printf("\rworking: %d/%d restarts...          ", finished_count, options->restart_count);
+		fflush(stdout);
+		mutex_unlock(&restarts->mutex);
+	}
+	free(score);
+	free(rota);
+	STATS_MERGE_THREAD();
+	return THREAD_RETURN;
+}
 
-					case CATEGORY_END_DATE:
-						if (config->people[person].last_day != 7*config->week_count - 1) {
-							fprintf(stderr, "cannot set multiple end dates per person!\n");
-							exit(-1);
-						}
-						config->people[person].last_day = rota_day_index;
-						break;
+int compare_values_descending(void const *a, void const *b)
+{
+	double const x = *(double const *)a;
+	double const y = *(double const *)b;
+	return (x < y) - (x > y);
+}
 
-					case CATEGORY_BANK_HOLIDAY:
-						set_bank_holiday(config, rota_day_index);
-						++config->total_bank_holidays_and_bias;
-						break;
+void run_restarts(
+	config_t const *config,
+	points_t const *points,
+	options_t const *options,
+	rng_t *rng,
+	rota_t *best_rota,
+	run_stats_t *stats)
+{
+	int const restart_count = options->restart_count;
+	int const thread_count = options->thread_count;
+	double const start_time = get_seconds();
+
+	restarts_t restarts;
+	memset(&restarts, 0, sizeof(restarts_t));
+	restarts.config = config;
+	restarts.points = points;
+	restarts.options = options;
+	restarts.rngs = (rng_t *)malloc(restart_count*sizeof(rng_t));
+	restarts.values = (double *)malloc(restart_count*sizeof(double));
+	restarts.failure_counts = (int *)malloc(restart_count*sizeof(int));
+	mutex_init(&restarts.mutex);
+
+	// streams are handed out in restart order before any thread starts
+	for (int i = 0; i < restart_count; ++i) {
+		rng_split(rng, &restarts.rngs[i]);
+	}
 
-					case CATEGORY_BANK_HOLIDAY_BIAS:
-						config->people[person].bank_holiday_bias = atof(line);
-						break;
+	thread_t threads[MAX_THREAD_COUNT];
+	restarts_thread_t thread_args[MAX_THREAD_COUNT];
+	for (int i = 0; i < thread_count; ++i) {
+		thread_args[i].restarts = &restarts;
+		thread_args[i].best_rota = alloc_rota(config);
+		thread_start(&threads[i], restarts_thread, &thread_args[i]);
+	}
+	int best_restart_index = -1;
+	double best_value = 0.0;
+	for (int i = 0; i < thread_count; ++i) {
+		restarts_thread_t const *const thread = &thread_args[i];
+		thread_join(&threads[i]);
+		if (thread->best_restart_index == -1) {
+			continue;
+		}
 
-					case CATEGORY_WARD_WEEK_BIAS:
-						config->people[person].ward_week_bias = atof(line);
-						break;
+		// ties go to the earliest restart
+		if (best_restart_index == -1
+			|| thread->best_value > best_value
+			|| (thread->best_value == best_value && thread->best_restart_index < best_restart_index)) {
+			copy_rota(best_rota, thread->best_rota);
+			best_value = thread->best_value;
+			best_restart_index = thread->best_restart_index;
+		}
+	}
+	mutex_destroy(&restarts.mutex);
+
+	// report the spread of final scores
+	int valid_count = 0;
+	double sum = 0.0;
+	for (int i = 0; i < restart_count; ++i) {
+		if (restarts.failure_counts[i] == 0) {
+			++valid_count;
+		}
+		sum += restarts.values[i];
+	}
+	qsort(restarts.values, restart_count, sizeof(double), compare_values_descending);
+	printf("\rrestart scores (best restart was %d):          \n", best_restart_index + 1);
+	printf("  best %f, upper quartile %f, median %f, lower quartile %f, worst %f\n",
+		restarts.values[0],
+		restarts.values[restart_count/4],
+		restarts.values[restart_count/2],
+		restarts.values[(3*restart_count)/4],
+		restarts.values[restart_count - 1]);
+	printf("  mean %f, %d of %d valid\n", sum/(double)restart_count, valid_count, restart_count);
+	for (int i = 0; i < STOP_COUNT; ++i) {
+		if (restarts.stop_reason_counts[i] > 0) {
+			printf("  %d stopped with %s\n", restarts.stop_reason_counts[i], g_stop_reason_names[i]);
+		}
+	}
 
-					case CATEGORY_ON_CALL_DAY_BIAS:
-						config->people[person].on_call_day_bias = atof(line);
-						break;
+	// only the iteration total is comparable between restarts
+	stats->stop_reason = STOP_MAX_ITERATIONS;
+	stats->iteration_count = restarts.iteration_count;
+	stats->seconds = get_seconds() - start_time;
+	stats->first_valid_iteration = -1;
+	stats->move_mix = restarts.move_mix;
 
-					case CATEGORY_ON_CALL_WEEKEND_BIAS:
-						config->people[person].on_call_weekend_bias = atof(line);
-						break;
+	for (int i = 0; i < thread_count; ++i) {
+		free(thread_args[i].best_rota);
+	}
+	free(restarts.failure_counts);
+	free(restarts.values);
+	free(restarts.rngs);
+}
 
-					case CATEGORY_NO_WARD_WEEKS:
-						config->people[person].cannot_do_ward_weeks = true;
-						break;
+/*
+	Parallel tempering.
 
-					case CATEGORY_FORCE_ON_CALL_DAY:
-						if (config->forced_on_call_people[rota_day_index] != -1) {
-							fprintf(stderr, "multiple people are set as must be on call on the same day!\n");
-							exit(-1);
-						}
-						config->forced_on_call_people[rota_day_index] = person;
-						break;
+	Each replica runs Metropolis at a fixed temperature.  Every exchange
+	interval the threads meet at a barrier and one of them proposes swaps
+	between neighbouring temperatures (alternating even and odd pairs), and
+	gathers the best rota found so far by any replica.  Replicas swap
+	temperatures rather than rotas, so an exchange costs nothing.
+*/
 
-					default:
-						fprintf(stderr, "internal error: unknown category!\n");
-						exit(-1);
-						break;
-				}
-			}
-			line = next;
-		}
-	}
+typedef struct
+{
+	rota_t *rota;
+	delta_t *delta;
+	rng_t rng;
+	float temperature;
+	rota_t *best_rota;
+	double best_value;
+	int best_failure_count;
+	selector_t selector;
+} replica_t;
 
-	free(line_buf);
-	fclose(fp);
+typedef struct
+{
+	config_t const *config;
+	options_t const *options;
+	int64_t round_count;
+	replica_t replicas[MAX_REPLICA_COUNT];
+	int ladder[MAX_REPLICA_COUNT];
+	int swap_attempt_counts[MAX_REPLICA_COUNT];
+	int swap_accept_counts[MAX_REPLICA_COUNT];
+	rng_t rng;
+	barrier_t barrier;
+	rota_t *best_rota;
+	double best_value;
+	int best_failure_count;
+	int64_t last_improvement_round;
+	double start_time;
+	int64_t completed_round_count;
+	int64_t first_valid_iteration;
+	double first_valid_seconds;
+	bool is_stopped;
+	stop_reason_t stop_reason;
+	int last_percent;
+} tempering_t;
 
-	// compute effective full time rate according to first and last days, biased totals
-	int const total_day_count = 7*config->week_count;
-	for (int person_index = 0; person_index < config->person_count; ++person_index) {
-		person_config_t *const person = &config->people[person_index];
-		for (int i = 0; i < person->first_day; ++i) {
-			set_holiday_day(config, i, person_index);
-		}
-		for (int i = person->first_day; i <= person->last_day; ++i) {
-			if (!is_holiday_day(config, i, person_index)) {
-				++person->total_non_holiday_days;
-			}
+typedef struct
+{
+	tempering_t *tempering;
+	int thread_index;
+} tempering_thread_t;
+
+void run_replica(
+	config_t const *config,
+	options_t const *options,
+	replica_t *replica,
+	int iteration_count)
+{
+	delta_t *const delta = replica->delta;
+	selector_t *const selector = (options->move_selection == MOVES_ADAPTIVE) ? &replica->selector : NULL;
+	for (int i = 0; i < iteration_count; ++i) {
+		double const current_value = delta->value;
+		move_t const move = mutate_random(config, &replica->rng, delta, options->batch_size, options->repair_rate, selector);
+
+		// metropolis at this replica's temperature
+		STATS_BEGIN(accept);
+		bool const accept = accept_change(&replica->rng, (float)(delta->value - current_value), replica->temperature);
+		STATS_RECORD_MOVE(move, accept, delta->value > current_value);
+		if (selector) {
+			update_selector(selector, delta, move, accept && delta->value > current_value);
 		}
-		for (int i = person->last_day + 1; i < total_day_count; ++i) {
-			set_holiday_day(config, i, person_index);
+		if (accept) {
+			delta_commit(delta);
+		} else {
+			delta_rollback(delta);
 		}
+		STATS_END(accept, SECTION_ACCEPT);
 
-		int const person_day_count = 1 + person->last_day - person->first_day;
-		float const rota_amount = (float)person_day_count/(float)total_day_count;
-		person->effective_full_time_amount = person->full_time_amount*rota_amount;
-
-		if (person->cannot_do_ward_weeks && person->ward_week_bias != 0) {
-			fprintf(stderr, "person that cannot do ward weeks cannot have a ward week bias!\n");
-			exit(-1);
+		if (delta->value > replica->best_value) {
+			copy_rota(replica->best_rota, replica->rota);
+			replica->best_value = delta->value;
+			replica->best_failure_count = delta->failure_count;
 		}
+	}
+}
 
-		config->total_on_call_days_and_bias += person->on_call_day_bias;
-		config->total_on_call_weekends_and_bias += person->on_call_weekend_bias;
-		config->total_ward_weeks_and_bias += person->ward_week_bias;
-		config->total_bank_holidays_and_bias += person->bank_holiday_bias;
-		config->effective_on_call_person_count += person->effective_full_time_amount;
-		if (!person->cannot_do_ward_weeks) {
-			config->effective_ward_person_count += person->effective_full_time_amount;
+void exchange_replicas(tempering_t *tempering, int64_t round_index)
+{
+	options_t const *const options = tempering->options;
+	int const replica_count = options->replica_count;
+
+	// gather the best so far
+	for (int i = 0; i < replica_count; ++i) {
+		replica_t const *const replica = &tempering->replicas[i];
+		if (replica->best_value > tempering->best_value) {
+			copy_rota(tempering->best_rota, replica->best_rota);
+			tempering->best_value = replica->best_value;
+			tempering->best_failure_count = replica->best_failure_count;
+			tempering->last_improvement_round = round_index;
 		}
 	}
 
-	// compute target working days and day off block sizes for each person
-	for (int person_index = 0; person_index < config->person_count; ++person_index) {
-		person_config_t *const person = &config->people[person_index];
-
-		float const on_call_ratio = person->effective_full_time_amount/config->effective_on_call_person_count;
-		float const ward_ratio = person->cannot_do_ward_weeks ? 0.f : (person->effective_full_time_amount/config->effective_ward_person_count);
-
-		person->target_on_call_days = on_call_ratio*config->total_on_call_days_and_bias;
-		person->target_on_call_weekends = on_call_ratio*config->total_on_call_weekends_and_bias;
-		person->target_ward_weeks = ward_ratio*config->total_ward_weeks_and_bias;
-		person->target_on_call_bank_holidays = on_call_ratio*config->total_bank_holidays_and_bias;
+	// propose swaps between neighbouring temperatures
+	for (int k = round_index & 1; k + 1 < replica_count; k += 2) {
+		replica_t *const cold = &tempering->replicas[tempering->ladder[k]];
+		replica_t *const hot = &tempering->replicas[tempering->ladder[k + 1]];
+		float const x = (float)(hot->delta->value - cold->delta->value)*(1.f/cold->temperature - 1.f/hot->temperature);
+		++tempering->swap_attempt_counts[k];
+		if (x >= 0.f || rota_rand_float(&tempering->rng) < expf(x)) {
+			++tempering->swap_accept_counts[k];
+			int const index = tempering->ladder[k];
+			tempering->ladder[k] = tempering->ladder[k + 1];
+			tempering->ladder[k + 1] = index;
+			float const temperature = cold->temperature;
+			cold->temperature = hot->temperature;
+			hot->temperature = temperature;
+		}
+	}
 
-		float const expected_on_call_days = person->target_on_call_days - person->on_call_day_bias;
-		float const expected_on_call_weekends = person->target_on_call_weekends - person->on_call_weekend_bias;
-		float const expected_ward_weeks = person->target_ward_weeks - person->ward_week_bias;
+	tempering->completed_round_count = round_index + 1;
 
-		float const expected_working_days = expected_on_call_days + 2.f*expected_on_call_weekends + 5.f*expected_ward_weeks;
+	// rescore each replica from scratch now and then, as for a single chain
+	int64_t const iteration_count = (round_index + 1)*options->exchange_interval;
+	if (iteration_count % DELTA_RESYNC_INTERVAL < options->exchange_interval) {
+		for (int i = 0; i < replica_count; ++i) {
+			replica_t *const replica = &tempering->replicas[i];
+			delta_init(replica->delta, tempering->config, replica->delta->points, replica->rota);
+		}
+	}
+	if (tempering->first_valid_iteration == -1 && tempering->best_failure_count == 0) {
+		tempering->first_valid_iteration = (round_index + 1)*options->exchange_interval*replica_count;
+		tempering->first_valid_seconds = get_seconds() - tempering->start_time;
+	}
 
-		float const expected_follow_on_shifts = MIN(expected_ward_weeks, expected_on_call_weekends);
-		float const expected_shift_count = expected_on_call_days + expected_on_call_weekends + expected_ward_weeks - expected_follow_on_shifts;
+	// stop early?
+	float progress = (options->max_iterations > 0) ? (float)((double)(round_index + 1)/(double)tempering->round_count) : 0.f;
+	int64_t const stall_iteration_count = (round_index - tempering->last_improvement_round)*options->exchange_interval*replica_count;
+	if (options->time_limit > 0.0) {
+		double const elapsed = get_seconds() - tempering->start_time;
+		progress = MAX(progress, (float)(elapsed/options->time_limit));
+		if (elapsed >= options->time_limit) {
+			tempering->is_stopped = true;
+			tempering->stop_reason = STOP_TIME_LIMIT;
+		}
+	}
+	if (options->stall_iterations > 0 && stall_iteration_count >= options->stall_iterations) {
+		tempering->is_stopped = true;
+		tempering->stop_reason = STOP_STALL_ITERATIONS;
+	}
+	if (is_target_reached(options, tempering->best_value, tempering->best_failure_count)) {
+		tempering->is_stopped = true;
+		tempering->stop_reason = STOP_TARGET_SCORE;
+	}
 
-		person->target_day_off_block_size = (person->total_non_holiday_days - expected_working_days)/expected_shift_count;
-		person->target_ward_week_spacing = person->total_non_holiday_days/expected_ward_weeks;
+	// progress?
+	int const percent = (int)(100.f*MIN(progress, 1.f));
+	if (percent != tempering->last_percent) {
+		double const coldest_value = tempering->replicas[tempering->ladder[0]].delta->value;
+		printf("\rworking: %d%% (%f/%f points)...          ", percent, tempering->best_value, coldest_value);
+		fflush(stdout);
+		tempering->last_percent = percent;
 	}
 }
 
-enum
-{
-	CHANNEL_HOLIDAY,
-	CHANNEL_FORCED_ON_CALL,
-	CHANNEL_CANNOT_ON_CALL,
-	CHANNEL_DISLIKE_ON_CALL,
-	CHANNEL_CANNOT_WARD_WEEK,
-	CHANNEL_DISLIKE_WARD_WEEK,
-	CHANNEL_COUNT
-};
-
-static char const *const g_channel_names[CHANNEL_COUNT] =
+THREAD_FUNC(tempering_thread, arg)
 {
-	NAME_HOLIDAY,
-	NAME_FORCE_ON_CALL_DAY,
-	NAME_CANNOT_ON_CALL_DAY,
-	NAME_DISLIKE_ON_CALL_DAY,
-	NAME_CANNOT_WARD_WEEK,
-	NAME_DISLIKE_WARD_WEEK
-};
+	tempering_thread_t const *const thread = (tempering_thread_t const *)arg;
+	tempering_t *const tempering = thread->tempering;
+	options_t const *const options = tempering->options;
+	for (int64_t round_index = 0; round_index < tempering->round_count; ++round_index) {
+		for (int i = thread->thread_index; i < options->replica_count; i += options->thread_count) {
+			run_replica(tempering->config, options, &tempering->replicas[i], options->exchange_interval);
+		}
+		if (barrier_wait(&tempering->barrier)) {
+			exchange_replicas(tempering, round_index);
+		}
+		barrier_wait(&tempering->barrier);
+		if (tempering->is_stopped) {
+			break;
+		}
+	}
+	STATS_MERGE_THREAD();
+	return THREAD_RETURN;
+}
 
-void print_config_html(config_t const *config, points_t const *points, char const *filename)
+void run_tempering(
+	config_t const *config,
+	points_t const *points,
+	options_t const *options,
+	rng_t *rng,
+	rota_t *best_rota,
+	run_stats_t *stats)
 {
-	FILE *const fp = fopen(filename, "w");
-	if (!fp) {
-		fprintf(stderr, "failed to open \"%s\" for writing!\n", filename);
-		exit(-1);
+	int const replica_count = options->replica_count;
+	int const thread_count = options->thread_count;
+	double const start_time = get_seconds();
+
+	tempering_t *const tempering = (tempering_t *)malloc(sizeof(tempering_t));
+	memset(tempering, 0, sizeof(tempering_t));
+	tempering->config = config;
+	tempering->options = options;
+	tempering->best_rota = best_rota;
+	rng_split(rng, &tempering->rng);
+
+	// split the iteration count between the replicas, if there is one
+	if (options->max_iterations > 0) {
+		int64_t const iteration_count = MAX(options->max_iterations/replica_count, 1);
+		tempering->round_count = iteration_count/options->exchange_interval + (iteration_count % options->exchange_interval != 0);
+	} else {
+		tempering->round_count = INT64_MAX;
+	}
+	tempering->stop_reason = STOP_MAX_ITERATIONS;
+	tempering->first_valid_iteration = -1;
+
+	// each replica starts from its own random rota
+	for (int i = 0; i < replica_count; ++i) {
+		replica_t *const replica = &tempering->replicas[i];
+		replica->rota = alloc_rota(config);
+		replica->delta = alloc_delta(config);
+		replica->best_rota = alloc_rota(config);
+		rng_split(rng, &replica->rng);
+		replica->temperature = options->temperatures[i];
+		init_selector(&replica->selector, options->batch_size);
+		init_rota(config, points, options->init, &replica->rng, replica->rota);
+		delta_init(replica->delta, config, points, replica->rota);
+		copy_rota(replica->best_rota, replica->rota);
+		replica->best_value = replica->delta->value;
+		replica->best_failure_count = replica->delta->failure_count;
+		tempering->ladder[i] = i;
+		if (i == 0 || replica->best_value > tempering->best_value) {
+			copy_rota(best_rota, replica->rota);
+			tempering->best_value = replica->best_value;
+			tempering->best_failure_count = replica->best_failure_count;
+		}
+	}
+	tempering->start_time = get_seconds();
+	if (tempering->best_failure_count == 0) {
+		tempering->first_valid_iteration = 0;
 	}
 
-	fprintf(fp, "<!DOCTYPE html>\n\
-<html>\n\
-<head>\n\
-<style>\n\
-table, th, td {\n\
-border: 1px solid black;\n\
-border-collapse: collapse;\n\
-}\n\
-th, td {\n\
-padding: 5px;\n\
-}\n\
-table tr td {\n\
-width: 10px;\n\
-}\n\
-</style>\n\
-</head>\n\
-<body>\n\
-<h1>Rota Input</h1>\n\
-");
+	// run the threads
+	barrier_init(&tempering->barrier, thread_count);
+	thread_t threads[MAX_THREAD_COUNT];
+	tempering_thread_t thread_args[MAX_THREAD_COUNT];
+	for (int i = 0; i < thread_count; ++i) {
+		thread_args[i].tempering = tempering;
+		thread_args[i].thread_index = i;
+		thread_start(&threads[i], tempering_thread, &thread_args[i]);
+	}
+	for (int i = 0; i < thread_count; ++i) {
+		thread_join(&threads[i]);
+	}
+	barrier_destroy(&tempering->barrier);
+
+	// report how well the ladder mixes
+	printf("\rreplica exchange acceptance:          \n");
+	for (int k = 0; k + 1 < replica_count; ++k) {
+		int const attempt_count = tempering->swap_attempt_counts[k];
+		printf("  %f <-> %f: %.1f%%\n",
+			options->temperatures[k],
+			options->temperatures[k + 1],
+			(attempt_count > 0) ? (100.f*(float)tempering->swap_accept_counts[k]/(float)attempt_count) : 0.f);
+	}
 
-	fprintf(fp, "<table>\n<tr>\n<th>Name</th><th>Category</th>\n");
-	for (int week_index = 0; week_index < config->week_count; ++week_index) {
-		time_t const first_day = config->first_day + week_index*7*TIME_DELTA_DAY;
-		tm_t *const tm = localtime(&first_day);
-		fprintf(fp, "<th colspan=\"7\">%d/%d/%d</th>\n", tm->tm_mday, tm->tm_mon + 1, tm->tm_year + EPOCH_YEAR);
+	memset(&stats->move_mix, 0, sizeof(move_mix_t));
+	for (int i = 0; i < replica_count; ++i) {
+		replica_t *const replica = &tempering->replicas[i];
+		if (options->move_selection == MOVES_ADAPTIVE) {
+			add_move_mix(&stats->move_mix, &replica->selector);
+		}
+		free(replica->best_rota);
+		free(replica->delta);
+		free(replica->rota);
 	}
-	fprintf(fp, "</tr>\n");
+	stats->stop_reason = tempering->stop_reason;
+	stats->iteration_count = tempering->completed_round_count*options->exchange_interval*replica_count;
+	stats->seconds = get_seconds() - start_time;
+	stats->first_valid_iteration = tempering->first_valid_iteration;
+	stats->first_valid_seconds = tempering->first_valid_seconds;
+	free(tempering);
+}
 
-	for (int person_index = 0; person_index < config->person_count; ++person_index) {
-		person_config_t const *const person = &config->people[person_index];
-		for (int channel = 0; channel < CHANNEL_COUNT; ++channel) {
-			fprintf(fp, "<tr>");
-			if (channel == 0) {
-				fprintf(fp, "<td rowspan=\"%d\" style=\"white-space: nowrap\"><strong>%s</strong>", CHANNEL_COUNT, person->name);
-				if (person->full_time_amount != 1.f) {
-					fprintf(fp, "<br>%s: %f", NAME_PART_TIME, person->full_time_amount);
-				}
-				if (person->on_call_day_bias != 0.f) {
-					fprintf(fp, "<br>%s: %f", NAME_ON_CALL_DAY_BIAS, person->on_call_day_bias);
-				}
-				if (person->on_call_weekend_bias != 0.f) {
-					fprintf(fp, "<br>%s: %f", NAME_ON_CALL_WEEKEND_BIAS, person->on_call_weekend_bias);
-				}
-				if (person->ward_week_bias != 0.f) {
-					fprintf(fp, "<br>%s: %f", NAME_WARD_WEEK_BIAS, person->ward_week_bias);
-				}
-				if (person->bank_holiday_bias != 0.f) {
-					fprintf(fp, "<br>%s: %f", NAME_BANK_HOLIDAY_BIAS, person->bank_holiday_bias);
-				}
-				if (person->cannot_do_ward_weeks) {
-					fprintf(fp, "<br>%s", NAME_NO_WARD_WEEKS);
-				}
-				fprintf(fp, "</td>\n");
-			}
-			fprintf(fp, "<td style=\"white-space: nowrap\">%s</td>\n", g_channel_names[channel]);
-			for (int week_index = 0; week_index < config->week_count; ++week_index) {
-				for (int weekday_index = 0; weekday_index < 7; ++weekday_index) {
-					int const rota_day_index = 7*week_index + weekday_index;
-					char const *extra = "";
-					if (is_bank_holiday(config, rota_day_index)) {
-						extra = " style=\"background-color:lightblue\"";
-					} else if (weekday_index >= 5) {
-						extra = " style=\"background-color:cyan\"";
-					}
-					switch (channel) {
-						case CHANNEL_HOLIDAY:
-							if (rota_day_index < person->first_day || person->last_day < rota_day_index) {
-								extra = " style=\"background-color:black\"";
-							} else if (is_holiday_day(config, rota_day_index, person_index)) {
-								extra = " style=\"background-color:grey\"";
-							}
-							break;
+/*
+	Kernel benchmarks.
 
-						case CHANNEL_FORCED_ON_CALL:
-							if (config->forced_on_call_people[rota_day_index] == person_index) {
-								extra = " style=\"background-color:green\"";
-							}
-							break;
+	Each kernel is called in a loop on inputs prepared from the parsed
+	config.  The call count is doubled until a trial takes long enough to
+	time, which also warms up caches and branch predictors, then a number
+	of trials are timed to give a mean and spread in ns per call.  Every
+	kernel returns a checksum so the compiler cannot drop the work.
+*/
 
-						case CHANNEL_CANNOT_ON_CALL:
-							if (is_invalid_on_call_day(config, rota_day_index, person_index)) {
-								extra = " style=\"background-color:darkred\"";
-							}
-							break;
+#define BENCH_ROTA_COUNT		64
+#define BENCH_CHANGE_COUNT		1024
+#define BENCH_TRIAL_SECONDS		.1
+#define BENCH_TRIAL_COUNT		10
 
-						case CHANNEL_DISLIKE_ON_CALL:
-							if (is_disliked_on_call_day(config, rota_day_index, person_index)) {
-								extra = " style=\"background-color:red\"";
-							}
-							break;
+typedef struct
+{
+	config_t const *config;
+	points_t const *points;
+	options_t const *options;
+	rng_t rng;
+	rota_t *rotas[BENCH_ROTA_COUNT];
+	score_t *score;
+	rota_t *rota;
+	delta_t *delta;
+	float changes[BENCH_CHANGE_COUNT];
+	float temperature;
+	int candidate_count;
+	slot_checks_t checks[BENCH_ROTA_COUNT];
+	int candidates[BENCH_ROTA_COUNT][MAX_BATCH_SIZE];
+	int failure_counts[MAX_BATCH_SIZE];
+} bench_t;
+
+typedef double (*bench_kernel_func_t)(bench_t *bench, int call_count);
+
+double bench_score_rota(bench_t *bench, int call_count)
+{
+	double checksum = 0.0;
+	for (int i = 0; i < call_count; ++i) {
+		score_rota(bench->config, bench->points, bench->rotas[i % BENCH_ROTA_COUNT], bench->score);
+		checksum += bench->score->value;
+	}
+	return checksum;
+}
 
-						case CHANNEL_CANNOT_WARD_WEEK:
-							if (weekday_index < 5 && is_invalid_ward_week(config, week_index, person_index)) {
-								extra = " style=\"background-color:orange\"";
-							}
-							break;
+double bench_reassign(bench_t *bench, int call_count)
+{
+	double checksum = 0.0;
+	for (int i = 0; i < call_count; ++i) {
+		mutate_random_reassign(bench->config, &bench->rng, bench->delta);
+		checksum += bench->delta->value;
+		delta_rollback(bench->delta);
+	}
+	return checksum;
+}
 
-						case CHANNEL_DISLIKE_WARD_WEEK:
-							if (weekday_index < 5 && is_disliked_ward_week(config, week_index, person_index)) {
-								extra = " style=\"background-color:yellow\"";
-							}
-							break;
-					}
-					fprintf(fp, "<td%s></td>\n", extra);
-				}
-			}
-			fprintf(fp, "</tr>\n");
-		}
+double bench_batched_reassign(bench_t *bench, int call_count)
+{
+	double checksum = 0.0;
+	for (int i = 0; i < call_count; ++i) {
+		mutate_batched_reassign(bench->config, &bench->rng, bench->delta, bench->options->batch_size);
+		checksum += bench->delta->value;
+		delta_rollback(bench->delta);
 	}
-	fprintf(fp, "<table>\n");
+	return checksum;
+}
 
-	fprintf(fp, "<h1>Points</h1>\n<table>\n<tr><th>Name</th><th>Value</th></tr>");
-	for (int i = 0; i < POINTS_COUNT; ++i) {
-		fprintf(fp, "<tr><td>%s</td><td>%f</td>\n", g_points_names[i], points->values[i]);
+double bench_count_slot_failures_scalar(bench_t *bench, int call_count)
+{
+	int checksum = 0;
+	for (int i = 0; i < call_count; ++i) {
+		int const index = i % BENCH_ROTA_COUNT;
+		count_slot_failures_scalar(&bench->checks[index], bench->candidates[index], 0, bench->candidate_count, bench->failure_counts);
+		checksum += bench->failure_counts[i % bench->candidate_count];
 	}
-	fprintf(fp, "</table>\n");
+	return (double)checksum;
+}
 
-	fprintf(fp, "</body>\n</html>\n");
-	fclose(fp);
+double bench_count_slot_failures(bench_t *bench, int call_count)
+{
+	int checksum = 0;
+	for (int i = 0; i < call_count; ++i) {
+		int const index = i % BENCH_ROTA_COUNT;
+		count_slot_failures(&bench->checks[index], bench->candidates[index], bench->candidate_count, bench->failure_counts);
+		checksum += bench->failure_counts[i % bench->candidate_count];
+	}
+	return (double)checksum;
+}
 
-	printf("written input to \"%s\"\n", filename);
+double bench_swap(bench_t *bench, int call_count)
+{
+	double checksum = 0.0;
+	for (int i = 0; i < call_count; ++i) {
+		mutate_random_swap(bench->config, &bench->rng, bench->delta);
+		checksum += bench->delta->value;
+		delta_rollback(bench->delta);
+	}
+	return checksum;
 }
 
-typedef struct
+double bench_rota_rand(bench_t *bench, int call_count)
 {
-	rota_t *rota;
-	score_t *score;
-} state_t;
+	int checksum = 0;
+	for (int i = 0; i < call_count; ++i) {
+		checksum += rota_rand(&bench->rng, bench->config->person_count);
+	}
+	return (double)checksum;
+}
 
-void swap_state(state_t *a, state_t *b)
+double bench_accept_change(bench_t *bench, int call_count)
 {
-	state_t const c = *a;
-	*a = *b;
-	*b = c;
+	int checksum = 0;
+	for (int i = 0; i < call_count; ++i) {
+		checksum += accept_change(&bench->rng, bench->changes[i % BENCH_CHANGE_COUNT], bench->temperature);
+	}
+	return (double)checksum;
 }
 
-void read_points(char const *filename, points_t *points)
+double bench_kernel(bench_t *bench, char const *name, bench_kernel_func_t func)
 {
-	memset(points, 0, sizeof(points_t));
+	// warm up, then double the call count until one trial takes long enough to time
+	double checksum = func(bench, BENCH_ROTA_COUNT);
+	int call_count = BENCH_ROTA_COUNT;
+	for (;;) {
+		double const start = get_seconds();
+		checksum += func(bench, call_count);
+		if (get_seconds() - start >= BENCH_TRIAL_SECONDS || call_count >= INT_MAX/2) {
+			break;
+		}
+		call_count *= 2;
+	}
 
-	FILE *const fp = fopen(filename, "r");
-	if (!fp) {
-		fprintf(stderr, "failed to open file \"%s\" for reading!\n", filename);
-		exit(-1);
+	double sum = 0.0;
+	double sum_sq = 0.0;
+	double min_time = 0.0;
+	for (int trial = 0; trial < BENCH_TRIAL_COUNT; ++trial) {
+		double const start = get_seconds();
+		checksum += func(bench, call_count);
+		double const time = 1e9*(get_seconds() - start)/(double)call_count;
+		sum += time;
+		sum_sq += time*time;
+		if (trial == 0 || time < min_time) {
+			min_time = time;
+		}
 	}
+	double const mean = sum/(double)BENCH_TRIAL_COUNT;
+	double const variance = MAX(sum_sq/(double)BENCH_TRIAL_COUNT - mean*mean, 0.0);
+	printf("%-24s %10.1f %10.1f %10.1f %12d  (checksum %g)\n", name, mean, sqrt(variance), min_time, call_count, checksum);
+	return mean;
+}
 
-	char *const line_buf = malloc(MAX_LINE_LENGTH);
+void run_benchmarks(
+	config_t const *config,
+	points_t const *points,
+	options_t const *options,
+	rng_t *rng,
+	bool score_only)
+{
+	bench_t *const bench = (bench_t *)malloc(sizeof(bench_t));
+	memset(bench, 0, sizeof(bench_t));
+	bench->config = config;
+	bench->points = points;
+	bench->options = options;
+	rng_split(rng, &bench->rng);
+
+	// score a spread of random rotas so branches are not all predictable
+	for (int i = 0; i < BENCH_ROTA_COUNT; ++i) {
+		bench->rotas[i] = alloc_rota(config);
+		randomize_rota(config, &bench->rng, bench->rotas[i]);
+	}
+	bench->score = alloc_score(config);
+
+	// mutate a rota that has been annealed for a while, since a random one
+	// breaks so many constraints that it is not typical of the search
+	options_t warm_options = *options;
+	warm_options.max_iterations = (options->max_iterations > 0) ? MIN(options->max_iterations, 256*1024) : 256*1024;
+	run_stats_t stats;
+	bench->rota = alloc_rota(config);
+	bench->delta = alloc_delta(config);
+	run_single_chain(config, points, &warm_options, &bench->rng, bench->rota, false, &stats);
+	delta_init(bench->delta, config, points, bench->rota);
+
+	// acceptance tests on the changes from real moves at the starting temperature
+	float final_temperature = 0.f;
+	calibrate_temperatures(config, &bench->rng, bench->delta, options->batch_size, ANNEAL_INITIAL_ACCEPTANCE, &bench->temperature, &final_temperature);
+	for (int i = 0; i < BENCH_CHANGE_COUNT; ++i) {
+		double const current_value = bench->delta->value;
+		mutate_random(config, &bench->rng, bench->delta, options->batch_size, options->repair_rate, NULL);
+		bench->changes[i] = (float)(bench->delta->value - current_value);
+		delta_rollback(bench->delta);
+	}
 
-	for (;;) {
-		char *line = rota_get_line(line_buf, MAX_LINE_LENGTH, fp);
-		if (!line) {
-			break;
+	// candidate screening on the shifts and people a batched reassign would
+	// pick, a full batch when the run is not batched
+	bench->candidate_count = (options->batch_size > 1) ? options->batch_size : MAX_BATCH_SIZE;
+	for (int i = 0; i < BENCH_ROTA_COUNT; ++i) {
+		int const slot = pick_free_slot(config, &bench->rng);
+		get_slot_checks(config, bench->rota, slot/SHIFT_COUNT, slot % SHIFT_COUNT, &bench->checks[i]);
+		for (int j = 0; j < bench->candidate_count; ++j) {
+			bench->candidates[i][j] = pick_eligible_person(config, points, &bench->rng, slot/SHIFT_COUNT, slot % SHIFT_COUNT);
 		}
-		if (*line == '\0') {
-			continue;
+	}
+
+	printf("%d people, %d weeks, %d trials per kernel\n", config->person_count, config->week_count, BENCH_TRIAL_COUNT);
+	printf("%-24s %10s %10s %10s %12s\n", "kernel", "ns/call", "stddev", "min", "calls/trial");
+	bench_kernel(bench, "score_rota", bench_score_rota);
+	if (!score_only) {
+		bench_kernel(bench, "mutate_random_reassign", bench_reassign);
+		double batched_time = 0.0;
+		if (options->batch_size > 1) {
+			batched_time = bench_kernel(bench, "mutate_batched_reassign", bench_batched_reassign);
 		}
-		char *value = scan_for_next_column(line);
-		for (int i = 0;; ++i) {
-			if (i == POINTS_COUNT) {
-				fprintf(stderr, "unknown points \"%s\"!\n", line);
-				exit(-1);
-			}
-			if (strcmp(line, g_points_names[i]) == 0) {
-				points->values[i] = (float)atof(value);
-				break;
-			}
+		double const scalar_time = bench_kernel(bench, "count_failures_scalar", bench_count_slot_failures_scalar);
+#ifdef __AVX2__
+		double const vector_time = bench_kernel(bench, "count_failures_avx2", bench_count_slot_failures);
+#endif
+		bench_kernel(bench, "mutate_random_swap", bench_swap);
+		bench_kernel(bench, "rota_rand", bench_rota_rand);
+		bench_kernel(bench, "accept_change", bench_accept_change);
+
+		// screening throughput, in candidates rather than calls
+		printf("candidates per second with %d per call:\n", bench->candidate_count);
+		printf("%-24s %10.1fM\n", "count_failures_scalar", 1e3*bench->candidate_count/scalar_time);
+#ifdef __AVX2__
+		printf("%-24s %10.1fM\n", "count_failures_avx2", 1e3*bench->candidate_count/vector_time);
+#endif
+		if (options->batch_size > 1) {
+			printf("%-24s %10.1fM\n", "mutate_batched_reassign", 1e3*bench->candidate_count/batched_time);
 		}
 	}
 
-	free(line_buf);
+	free(bench->delta);
+	free(bench->rota);
+	free(bench->score);
+	for (int i = 0; i < BENCH_ROTA_COUNT; ++i) {
+		free(bench->rotas[i]);
+	}
+	free(bench);
+}
+
+void print_run_summary(
+	char const *filename,
+	options_t const *options,
+	config_t const *config,
+	run_stats_t const *stats,
+	score_t const *score)
+{
+	FILE *const fp = fopen(filename, "a");
+	if (!fp) {
+		fprintf(stderr, "failed to open \"%s\" for appending!\n", filename);
+		exit(-1);
+	}
+
+	// write the header when starting a new file
+	fseek(fp, 0, SEEK_END);
+	if (ftell(fp) == 0) {
+		fprintf(fp, "input,people,weeks,seed,iterations,seconds,iterations_per_second,first_valid_iteration,first_valid_seconds,score,failure_count,stop_reason\n");
+	}
+	fprintf(fp, "%s,%d,%d,%llu,%lld,%.3f,%.0f,",
+		options->input_filename,
+		config->person_count,
+		config->week_count,
+		(unsigned long long)options->seed,
+		(long long)stats->iteration_count,
+		stats->seconds,
+		(double)stats->iteration_count/MAX(stats->seconds, 1e-9));
+	if (stats->first_valid_iteration >= 0) {
+		fprintf(fp, "%lld,%.3f,", (long long)stats->first_valid_iteration, stats->first_valid_seconds);
+	} else {
+		fprintf(fp, ",,");
+	}
+	fprintf(fp, "%f,%d,%s\n",
+		score->value,
+		score->failure_count,
+		(options->restart_count > 0) ? "" : g_stop_reason_names[stats->stop_reason]);
 	fclose(fp);
 }
 
 int main(int argc, char *argv[])
 {
-	// deterministic seed
-	init_genrand(0xABCD0123U);
-
 	// parse arguments
-	if (argc > 2) {
-		fprintf(stderr, "rota\n");
-		exit(-1);
-	}
-	char const *const input_filename = (argc == 2) ? argv[1] : "input.csv";
+	options_t options;
+	parse_options(argc, argv, &options);
+
+	// deterministic seed
+	rng_t rng;
+	rng_init(&rng, options.seed);
+	init_accept_log_table();
+#if COLLECT_STATS
+	mutex_init(&g_stats_mutex);
+#endif
 
 	// get some heap
 	config_t *const config = (config_t *)malloc(sizeof(config_t));
-	state_t current, candidate, best;
-	current.rota = (rota_t *)malloc(sizeof(rota_t));
-	current.score = (score_t *)malloc(sizeof(score_t));
-	candidate.rota = (rota_t *)malloc(sizeof(rota_t));
-	candidate.score = (score_t *)malloc(sizeof(score_t));
-	best.rota = (rota_t *)malloc(sizeof(rota_t));
-	best.score = (score_t *)malloc(sizeof(score_t));
 	points_t *const points = malloc(sizeof(points_t));
 
 	// read config from file
-	read_config(input_filename, config);
-	read_points("points.csv", points);
+	read_config(options.input_filename, config);
+	if (options.from_filename) {
+		read_previous_rota(options.from_filename, config);
+	}
+	read_points("points.csv", config, points);
+	config->input_hash = hash_file(hash_file(HASH_OFFSET_BASIS, options.input_filename), "points.csv");
+	if (options.from_filename) {
+		config->input_hash = hash_file(config->input_hash, options.from_filename);
+	}
+	presolve(config, points);
+	if (options.from_filename) {
+		restrict_to_changed_weeks(config, points, options.from_window);
+	}
 	print_config_html(config, points, "check.html");
 
-	// randomly assign people to shifts
-	for (int i = 0; i < config->week_count; ++i) {
-		week_t *const week = &current.rota->weeks[i];
-		for (int j = 0; j < SHIFT_COUNT; ++j) {
-			week->shifts[j] = rota_rand(config->person_count);
-		}
+	if (options.bench_score || options.bench_kernels) {
+		run_benchmarks(config, points, &options, &rng, !options.bench_kernels);
+		return 0;
 	}
-	score_rota(config, points, current.rota, current.score);
-
-	// mutate to global optimum
-	int const run_count = 6*1024*1024;
-	int const acceptance_half_life = 256*1024;
-	int last_percent = 0;
-	memcpy(best.rota, current.rota, sizeof(rota_t));
-	memcpy(best.score, current.score, sizeof(score_t));
-	for (int i = 0; i < run_count; ++i) {
-		// progress?
-		int const percent = (int)(100.f*(float)i/(float)run_count);
-		if (percent != last_percent) {
-			printf("\rworking: %d%% (%f/%f points)...          ", percent, best.score->value, current.score->value);
-			fflush(stdout);
-			last_percent = percent;
-		}
 
-		// do mutation
-		switch (rota_rand(2)) {
-			default:	mutate_random_reassign(config, current.rota, candidate.rota);	break;
-			case 1:		mutate_random_swap(config, current.rota, candidate.rota);		break;
-		}
-		score_rota(config, points, candidate.rota, candidate.score);
-
-		// accept randomly or if better
-		float const accept_prob = powf(.5f, 1.f + (float)i/(float)acceptance_half_life);
-		float const u = (float)rota_rand(run_count)/(float)run_count;
-		if (candidate.score->value > current.score->value || u < accept_prob) {
-			swap_state(&current, &candidate);
-		}
+	// rota and score are sized for this config
+	state_t best;
+	best.rota = alloc_rota(config);
+	best.score = alloc_score(config);
+
+	// mutate to global optimum, each search timing itself so a resumed chain
+	// counts the time before its checkpoint along with its iterations
+	run_stats_t stats;
+	if (options.restart_count > 0) {
+		run_restarts(config, points, &options, &rng, best.rota, &stats);
+	} else if (options.replica_count > 0) {
+		run_tempering(config, points, &options, &rng, best.rota, &stats);
+	} else {
+		run_single_chain(config, points, &options, &rng, best.rota, true, &stats);
+	}
+	score_rota(config, points, best.rota, best.score);
+#if COLLECT_STATS
+	STATS_MERGE_THREAD();
+	print_stats_json(options.stats_filename);
+#endif
 
-		// keep track of best ever
-		if (i == 0 || current.score->value > best.score->value) {
-			memcpy(best.rota, current.rota, sizeof(rota_t));
-			memcpy(best.score, current.score, sizeof(score_t));
+	// print statistics
+	printf("\rran %lld iterations in %.1f seconds (%.0f per second)          \n",
+		(long long)stats.iteration_count,
+		stats.seconds,
+		(double)stats.iteration_count/MAX(stats.seconds, 1e-9));
+	if (options.restart_count == 0) {
+		printf("stopped with %s\n", g_stop_reason_names[stats.stop_reason]);
+		if (stats.first_valid_iteration >= 0) {
+			printf("first valid rota after %lld iterations (%.2f seconds)\n", (long long)stats.first_valid_iteration, stats.first_valid_seconds);
 		}
 	}
+	print_move_mix(&stats.move_mix);
+	if (options.summary_filename) {
+		print_run_summary(options.summary_filename, &options, config, &stats, best.score);
+	}
 
 	// print results
 	printf("\rfinished! best score: %f (%s)          \n", best.score->value, (best.score->failure_count == 0) ? "valid" : "invalid");
 	for (int i = 0; i < best.score->failure_count; ++i) {
 		failure_data_t const *const data = &best.score->failure_data[i];
 		person_config_t const *const person = &config->people[data->person_index];
-		time_t const day = config->first_day + data->rota_day_index*TIME_DELTA_DAY;
-		tm_t *const tm = localtime(&day);
-		printf("%s: %s (%d/%d/%d)\n",
+		printf("%s: %s (%s)\n",
 			person->name,
 			g_failure_names[data->failure],
-			tm->tm_mday, tm->tm_mon + 1, tm->tm_year + EPOCH_YEAR);
+			config->calendar[data->rota_day_index].date);
 	}
 	if (best.score->failure_count == MAX_FAILURE_COUNT) {
 		printf("there are potentially more issues with the rota than those printed above...\n");
 	}
+	if (config->previous_shifts) {
+		int changed_count = 0;
+		int known_count = 0;
+		for (int i = 0; i < config->week_count*SHIFT_COUNT; ++i) {
+			int const person = config->previous_shifts[i];
+			if (person != -1) {
+				++known_count;
+				if (person != best.rota->weeks[i/SHIFT_COUNT].shifts[i % SHIFT_COUNT]) {
+					++changed_count;
+				}
+			}
+		}
+		printf("changed %d of %d shifts from the previous rota\n", changed_count, known_count);
+	}
 	print_rota_html("output.html", config, best.rota, best.score);
 	print_rota_csv("output.csv", config, best.rota);
 	return 0;